@@ -0,0 +1,386 @@
+// arc.cpp
+// risk_arc: builds and queries replay archives (see archive.h). Players
+// are numbered from 1 as in the game.
+//   risk_arc add <dir> [--map <map>] [--bots <name1> <name2>] <journal>...
+//   risk_arc selfplay <dir> [--map <map>] [--games <n>] [--seed <s>]
+//   risk_arc query <dir> [--map <map>] [conditions] [--threads <n>] [--count]
+//   risk_arc export <dir> <game id> <out.jnl>
+//   risk_arc pack <in.jnl> <out.jnl>     packs and deflates any journal
+// Query conditions, all of which must hold:
+//   --id <n>  --seed <s>  --winner <p>  --loser <p>  --unfinished
+//   --bot <p> <name>  --turns <min> <max>  --actions <min> <max>
+//   --held <p> <where> <turn>   p owned all of where when turn began;
+//                               where is territory indices, territory
+//                               names or continent names, comma separated
+// e.g. games where player 2 held Asia at turn 10 and lost:
+//   risk_arc query games --held 2 asia 10 --loser 2
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "archive.h"
+#include "snapshot.h"
+
+namespace {
+
+const int kSelfplayMaxActions = 20000; // then the game is archived unfinished
+
+int usage(const char* argv0) {
+    std::fprintf(stderr,
+        "usage: %s add <dir> [--map <map>] [--bots <name1> <name2>] <journal>...\n"
+        "       %s selfplay <dir> [--map <map>] [--games <n>] [--seed <s>]\n"
+        "       %s query <dir> [--map <map>] [conditions] [--threads <n>] [--count]\n"
+        "       %s export <dir> <game id> <out.jnl>\n"
+        "       %s pack <in.jnl> <out.jnl>\n",
+        argv0, argv0, argv0, argv0, argv0);
+    return 2;
+}
+
+// a legal move for whoever is to play: reinforce the border, attack from
+// the border while it is strong enough, then move the biggest stack away
+// from the fighting to the border territory fewest hops from it
+Command randomMove(const Game &g, std::mt19937_64 &rng, std::vector<int> &border) {
+    Command cmd;
+    cmd.type = CMD_NEXT_PHASE;
+    int me = g.currentPlayer;
+    g.frontier(me, border);
+    auto pick = [&](const std::vector<int> &v) { return v[rng() % v.size()]; };
+
+    if (g.phase == PHASE_REINFORCE) {
+        if (g.reinforcementsLeft > 0 && !border.empty()) {
+            cmd.type = CMD_PLACE;
+            cmd.terr = pick(border);
+        }
+        return cmd;
+    }
+    if (g.phase == PHASE_FORTIFY) {
+        if (g.fortifyDone) return cmd;
+        int from = g.fortSel.fromTerr;
+        if (from < 0) {
+            for (int t = 0; t < (int)g.terrs.size(); ++t) {
+                if (g.terrs[t].owner != me || g.terrs[t].armies < 2) continue;
+                if (std::binary_search(border.begin(), border.end(), t)) continue;
+                if (from < 0 || g.terrs[t].armies > g.terrs[from].armies) from = t;
+            }
+            if (from < 0) return cmd;
+            cmd.type = CMD_FORTIFY_FROM;
+            cmd.terr = from;
+            return cmd;
+        }
+        const DistanceTable &dist = g.distances();
+        int best = -1;
+        for (int t : border) {
+            if (!g.regions.connected(from, t)) continue;
+            int hops = dist.distance(from, t);
+            if (hops > 0 && (cmd.terr < 0 || hops < best)) {
+                best = hops;
+                cmd.terr = t;
+            }
+        }
+        if (cmd.terr < 0) return cmd;
+        cmd.type = CMD_FORTIFY_TO;
+        cmd.armies = g.terrs[from].armies - 1;
+        return cmd;
+    }
+    if (g.phase != PHASE_ATTACK || rng() % 10 == 0) return cmd;
+
+    int from = g.attackSel.fromTerr;
+    if (from < 0 || g.terrs[from].armies < 2 || rng() % 4 == 0) {
+        std::vector<int> strong;
+        for (int t : border) {
+            if (g.terrs[t].armies >= 3) strong.push_back(t);
+        }
+        if (strong.empty()) return cmd;
+        cmd.type = CMD_ATTACK_FROM;
+        cmd.terr = pick(strong);
+        return cmd;
+    }
+    std::vector<int> enemies;
+    int count;
+    const uint32_t* nb = g.map->neighbors(from, count);
+    for (int k = 0; k < count; ++k) {
+        if (g.terrs[nb[k]].owner != me) enemies.push_back((int)nb[k]);
+    }
+    if (enemies.empty()) return cmd;
+    cmd.type = CMD_ATTACK_TO;
+    cmd.terr = pick(enemies);
+    return cmd;
+}
+
+// "where" of --held: indices, territory names or continent names
+bool parseWhere(const MapData &map, const std::string &where, std::vector<uint32_t> &terrs,
+                std::string &err) {
+    size_t pos = 0;
+    while (pos <= where.size()) {
+        size_t comma = where.find(',', pos);
+        if (comma == std::string::npos) comma = where.size();
+        std::string item = where.substr(pos, comma - pos);
+        pos = comma + 1;
+
+        char* end = nullptr;
+        long t = std::strtol(item.c_str(), &end, 10);
+        if (!item.empty() && *end == '\0') {
+            if (t < 0 || t >= (long)map.numTerrs) {
+                err = "no territory " + item;
+                return false;
+            }
+            terrs.push_back((uint32_t)t);
+            continue;
+        }
+        bool known = false;
+        for (uint32_t i = 0; i < map.numTerrs; ++i) {
+            if (map.territoryName((int)i) == item) {
+                terrs.push_back(i);
+                known = true;
+            }
+        }
+        for (size_t c = 0; c < map.continents.size() && !known; ++c) {
+            if (strncmp(map.continents[c].name, item.c_str(), sizeof(map.continents[c].name)) != 0) continue;
+            for (uint32_t i = 0; i < map.numTerrs; ++i) {
+                if (map.continentOf[i] == (int32_t)c) terrs.push_back(i);
+            }
+            known = true;
+        }
+        if (!known) {
+            err = "no territory or continent '" + item + "' on " + map.name;
+            return false;
+        }
+    }
+    return true;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+bool writeFile(const char* path, const std::vector<unsigned char> &bytes) {
+    FILE* f = std::fopen(path, "wb");
+    bool ok = f && std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    if (f) ok = std::fclose(f) == 0 && ok;
+    if (!ok) std::fprintf(stderr, "%s: cannot write\n", path);
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 3) return usage(argv[0]);
+    std::string cmd = argv[1];
+    std::string dir = argv[2];
+    std::string err;
+
+    if (cmd == "export") {
+        if (argc != 5) return usage(argv[0]);
+        ArchiveIndex idx;
+        if (!idx.open(dir, err)) {
+            std::fprintf(stderr, "%s\n", err.c_str());
+            return 1;
+        }
+        const ArchiveEntry* e = idx.find(std::strtoull(argv[3], nullptr, 10));
+        if (!e) {
+            std::fprintf(stderr, "%s: no game %s\n", dir.c_str(), argv[3]);
+            return 1;
+        }
+        Journal j;
+        std::vector<unsigned char> bytes;
+        if (!idx.readJournal(*e, j, err)) {
+            std::fprintf(stderr, "%s\n", err.c_str());
+            return 1;
+        }
+        encodeJournal(j, bytes);
+        return writeFile(argv[4], bytes) ? 0 : 1;
+    }
+
+    if (cmd == "pack") {
+        if (argc != 4) return usage(argv[0]);
+        Journal j;
+        std::vector<unsigned char> bytes;
+        if (!readJournal(argv[2], j, err)) {
+            std::fprintf(stderr, "%s\n", err.c_str());
+            return 1;
+        }
+        packJournal(j, true, bytes);
+        if (!writeFile(argv[3], bytes)) return 1;
+        std::printf("%zu records, %zu bytes (%zu unpacked)\n", j.records.size(), bytes.size(),
+                    16 + j.start.size() + j.records.size() * sizeof(JournalRecord));
+        return 0;
+    }
+
+    // the rest share --map; other options are per command
+    const char* mapPath = "maps/world.map";
+    std::vector<const char*> args;
+    for (int i = 3; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--map") == 0 && i + 1 < argc) mapPath = argv[++i];
+        else args.push_back(argv[i]);
+    }
+    auto need = [&](size_t i, size_t n) {
+        if (i + n < args.size()) return true;
+        std::fprintf(stderr, "%s needs %zu value(s)\n", args[i], n);
+        return false;
+    };
+
+    if (cmd == "add" || cmd == "selfplay") {
+        Game game;
+        if (!game.loadMap(mapPath, err)) {
+            std::fprintf(stderr, "%s\n", err.c_str());
+            return 1;
+        }
+        std::string bots[2] = {"human", "human"};
+        long games = 1000;
+        uint64_t seed = 1;
+        std::vector<const char*> journals;
+        for (size_t i = 0; i < args.size(); ++i) {
+            std::string a = args[i];
+            if (a == "--bots" && cmd == "add") {
+                if (!need(i, 2)) return 2;
+                bots[0] = args[i+1];
+                bots[1] = args[i+2];
+                i += 2;
+            } else if (a == "--games" && cmd == "selfplay") {
+                if (!need(i, 1)) return 2;
+                games = std::atol(args[++i]);
+            } else if (a == "--seed" && cmd == "selfplay") {
+                if (!need(i, 1)) return 2;
+                seed = std::strtoull(args[++i], nullptr, 10);
+            } else if (a.compare(0, 2, "--") == 0 || cmd == "selfplay") {
+                return usage(argv[0]);
+            } else {
+                journals.push_back(args[i]);
+            }
+        }
+
+        ArchiveWriter writer;
+        if (!writer.open(dir, err)) {
+            std::fprintf(stderr, "%s\n", err.c_str());
+            return 1;
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t id = 0;
+        long added = 0;
+        if (cmd == "add") {
+            for (const char* path : journals) {
+                Journal j;
+                if (!readJournal(path, j, err) || !writer.add(game, j, bots, id, err)) {
+                    std::fprintf(stderr, "%s: %s\n", path, err.c_str());
+                    continue;
+                }
+                ++added;
+            }
+        } else {
+            bots[0] = bots[1] = "random";
+            Game g = game;
+            Journal j;
+            std::vector<int> border;
+            for (long n = 0; n < games; ++n) {
+                g.newGame();
+                g.seedRng(seed + (uint64_t)n);
+                std::mt19937_64 rng(seed + (uint64_t)n);
+                j.start.resize(snapshotMaxBytes(g));
+                j.start.resize(writeSnapshot(g, j.start.data()));
+                j.records.clear();
+                for (int k = 0; k < kSelfplayMaxActions && !g.gameOver; ++k) {
+                    Command move = randomMove(g, rng, border);
+                    if (g.apply(move)) j.records.push_back(journalRecord(move, g));
+                }
+                if (!writer.add(game, j, bots, id, err)) {
+                    std::fprintf(stderr, "selfplay game %ld: %s\n", n, err.c_str());
+                    return 1;
+                }
+                ++added;
+            }
+        }
+        writer.close();
+        std::printf("%ld games added in %.2f s, last id %llu\n",
+                    added, secondsSince(t0), (unsigned long long)id);
+        return added == (long)journals.size() || cmd == "selfplay" ? 0 : 1;
+    }
+
+    if (cmd != "query") return usage(argv[0]);
+
+    std::string mapErr;
+    std::shared_ptr<const MapData> map = MapData::load(mapPath, mapErr);
+    ArchiveIndex idx;
+    if (!idx.open(dir, err)) {
+        std::fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+    }
+
+    ArchiveQuery q;
+    int threads = 0;
+    bool countOnly = false;
+    bool none = false; // a condition no game can meet, such as an unknown bot
+    auto player = [&](const char* s) {
+        int p = std::atoi(s);
+        if (p != 1 && p != 2) {
+            std::fprintf(stderr, "players are 1 or 2, not %s\n", s);
+            std::exit(2);
+        }
+        return p - 1;
+    };
+    for (size_t i = 0; i < args.size(); ++i) {
+        std::string a = args[i];
+        if (a == "--id" && need(i, 1)) {
+            q.gameId = std::atoll(args[++i]);
+        } else if (a == "--seed" && need(i, 1)) {
+            q.anySeed = false;
+            q.seed = std::strtoull(args[++i], nullptr, 10);
+        } else if (a == "--winner" && need(i, 1)) {
+            q.winner = player(args[++i]);
+        } else if (a == "--loser" && need(i, 1)) {
+            q.winner = 1 - player(args[++i]);
+        } else if (a == "--unfinished") {
+            q.winner = -1;
+        } else if (a == "--bot" && need(i, 2)) {
+            int p = player(args[i+1]);
+            q.bots[p] = idx.botId(args[i+2]);
+            if (q.bots[p] < 0) none = true;
+            i += 2;
+        } else if (a == "--turns" && need(i, 2)) {
+            q.minTurns = (uint32_t)std::atol(args[i+1]);
+            q.maxTurns = (uint32_t)std::atol(args[i+2]);
+            i += 2;
+        } else if (a == "--actions" && need(i, 2)) {
+            q.minActions = (uint32_t)std::atol(args[i+1]);
+            q.maxActions = (uint32_t)std::atol(args[i+2]);
+            i += 2;
+        } else if (a == "--held" && need(i, 3)) {
+            if (!map) {
+                std::fprintf(stderr, "%s\n", mapErr.c_str());
+                return 1;
+            }
+            HeldTest h;
+            h.player = player(args[i+1]);
+            h.turn = (uint32_t)std::atol(args[i+3]);
+            if (!parseWhere(*map, args[i+2], h.terrs, err)) {
+                std::fprintf(stderr, "%s\n", err.c_str());
+                return 2;
+            }
+            q.held.push_back(h);
+            q.mapFingerprint = map->fingerprint; // indices mean nothing on another map
+            i += 3;
+        } else if (a == "--threads" && need(i, 1)) {
+            threads = std::atoi(args[++i]);
+        } else if (a == "--count") {
+            countOnly = true;
+        } else {
+            return usage(argv[0]);
+        }
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<uint64_t> ids;
+    QueryStats stats;
+    if (!none && !runQuery(idx, q, threads, ids, stats, err)) {
+        std::fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+    }
+    if (countOnly) std::printf("%zu\n", ids.size());
+    else for (uint64_t id : ids) std::printf("%llu\n", (unsigned long long)id);
+    std::fprintf(stderr, "%zu of %zu games (%zu past the index) in %.3f s\n",
+                 ids.size(), idx.size(), stats.candidates, secondsSince(t0));
+    return 0;
+}
@@ -0,0 +1,535 @@
+// archive.cpp
+#include "archive.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+const char     kMagic[8] = {'R','I','S','K','A','R','C','1'};
+const uint32_t kVersion  = 3; // 2: journals packed, 3: a plane per player
+const size_t   kEntriesOffset = 64; // index header, padded to an entry
+const size_t   kChunkEntries = 8192; // index entries per query work item
+
+struct IndexHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t entryBytes;
+};
+
+// one game in a segment: this, then per turn an owner plane of planeBytes
+// for each player, then the journal, packed and deflated; queries on
+// owners stay in the first page
+struct GameRecordHeader {
+    char     magic[4];
+    uint32_t journalBytes;
+    uint32_t planeBytes;
+    uint32_t turns;
+};
+const char kRecordMagic[4] = {'R','G','A','M'};
+
+static_assert(sizeof(ArchiveEntry) == 64, "index entries are one cache line");
+
+std::string segmentPath(const std::string &dir, uint32_t seg) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/seg-%06u.rseg", seg);
+    return dir + name;
+}
+
+bool readBots(const std::string &dir, std::vector<std::string> &names) {
+    names.clear();
+    FILE* f = std::fopen((dir + "/bots.txt").c_str(), "r");
+    if (!f) return false;
+    char line[256];
+    while (std::fgets(line, sizeof(line), f)) {
+        std::string s = line;
+        while (!s.empty() && (s.back() == '\n' || s.back() == '\r')) s.pop_back();
+        names.push_back(s);
+    }
+    std::fclose(f);
+    return true;
+}
+
+bool writeAll(int fd, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    while (len > 0) {
+        ssize_t n = ::write(fd, p, len);
+        if (n < 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+long long fileSize(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? (long long)st.st_size : -1;
+}
+
+} // namespace
+
+// ---------------- writer ----------------
+
+ArchiveWriter::~ArchiveWriter() {
+    close();
+}
+
+bool ArchiveWriter::open(const std::string &path, std::string &err) {
+    close();
+    dir = path;
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        err = dir + ": cannot create";
+        return false;
+    }
+    readBots(dir, botNames);
+
+    std::string indexPath = dir + "/index.ridx";
+    indexFd = ::open(indexPath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (indexFd < 0) {
+        err = indexPath + ": cannot open";
+        return false;
+    }
+    struct stat st;
+    if (fstat(indexFd, &st) != 0) {
+        err = indexPath + ": cannot stat";
+        close();
+        return false;
+    }
+
+    size_t count = 0;
+    ArchiveEntry last;
+    if (st.st_size == 0) {
+        char pad[kEntriesOffset] = {};
+        IndexHeader hdr;
+        std::memcpy(hdr.magic, kMagic, sizeof(kMagic));
+        hdr.version = kVersion;
+        hdr.entryBytes = sizeof(ArchiveEntry);
+        std::memcpy(pad, &hdr, sizeof(hdr));
+        if (!writeAll(indexFd, pad, sizeof(pad))) {
+            err = indexPath + ": cannot write";
+            close();
+            return false;
+        }
+    } else {
+        IndexHeader hdr;
+        bool ok = (size_t)st.st_size >= kEntriesOffset &&
+                  pread(indexFd, &hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr) &&
+                  std::memcmp(hdr.magic, kMagic, sizeof(kMagic)) == 0 &&
+                  hdr.version == kVersion && hdr.entryBytes == sizeof(ArchiveEntry);
+        if (!ok) {
+            err = indexPath + ": not an archive index";
+            close();
+            return false;
+        }
+        // drop a torn entry, then any whose record is not all on disk
+        count = ((size_t)st.st_size - kEntriesOffset) / sizeof(ArchiveEntry);
+        while (count > 0) {
+            off_t at = (off_t)(kEntriesOffset + (count - 1) * sizeof(ArchiveEntry));
+            if (pread(indexFd, &last, sizeof(last), at) != (ssize_t)sizeof(last)) break;
+            if (fileSize(segmentPath(dir, last.segment)) >= (long long)(last.offset + last.bytes)) break;
+            --count;
+        }
+        if (ftruncate(indexFd, (off_t)(kEntriesOffset + count * sizeof(ArchiveEntry))) != 0) {
+            err = indexPath + ": cannot truncate";
+            close();
+            return false;
+        }
+    }
+    lseek(indexFd, 0, SEEK_END);
+
+    nextId = count ? last.gameId + 1 : 1;
+    return openSegment(count ? last.segment : 0, err);
+}
+
+bool ArchiveWriter::openSegment(uint32_t seg, std::string &err) {
+    if (segFd >= 0) ::close(segFd);
+    std::string path = segmentPath(dir, seg);
+    segFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (segFd < 0) {
+        err = path + ": cannot open";
+        return false;
+    }
+    struct stat st;
+    segBytes = fstat(segFd, &st) == 0 ? (uint64_t)st.st_size : 0;
+    segment = seg;
+    return true;
+}
+
+int ArchiveWriter::botId(const std::string &name, std::string &err) {
+    for (size_t i = 0; i < botNames.size(); ++i) {
+        if (botNames[i] == name) return (int)i;
+    }
+    if (name.empty() || name.size() > 200 || name.find_first_of("\r\n") != std::string::npos) {
+        err = "bad bot name '" + name + "'";
+        return -1;
+    }
+    if (botNames.size() >= 0xFFFF) {
+        err = "too many bot names";
+        return -1;
+    }
+    FILE* f = std::fopen((dir + "/bots.txt").c_str(), "a");
+    bool ok = f && std::fprintf(f, "%s\n", name.c_str()) > 0;
+    if (f) ok = std::fclose(f) == 0 && ok;
+    if (!ok) {
+        err = dir + "/bots.txt: cannot write";
+        return -1;
+    }
+    botNames.push_back(name);
+    return (int)botNames.size() - 1;
+}
+
+bool ArchiveWriter::add(const Game &onMap, const Journal &j, const std::string bots[2],
+                        uint64_t &id, std::string &err) {
+    if (indexFd < 0) {
+        err = "archive not open";
+        return false;
+    }
+    if (replay.map != onMap.map) replay = onMap;
+    if (!readSnapshot(replay, j.start.data(), j.start.size(), err)) return false;
+
+    ArchiveEntry e;
+    std::memset(&e, 0, sizeof(e));
+    e.seed = replay.rngSeed;
+    e.mapFingerprint = replay.map->fingerprint;
+    e.actions = (uint32_t)j.records.size();
+    for (int p = 0; p < 2; ++p) {
+        int b = botId(bots[p], err);
+        if (b < 0) return false;
+        e.bots[p] = (uint16_t)b;
+    }
+
+    // header, a plane per turn start, then the journal
+    GameRecordHeader hdr;
+    std::memcpy(hdr.magic, kRecordMagic, sizeof(kRecordMagic));
+    hdr.planeBytes = (replay.map->numTerrs + 7) / 8;
+    record.assign(sizeof(hdr), 0);
+
+    // a territory nobody holds is clear in both
+    auto addPlane = [&]() {
+        size_t at = record.size();
+        record.resize(at + 2 * hdr.planeBytes, 0);
+        unsigned char* planes = record.data() + at;
+        for (size_t t = 0; t < replay.terrs.size(); ++t) {
+            int owner = replay.terrs[t].owner;
+            if (owner == 0 || owner == 1) {
+                planes[owner * hdr.planeBytes + (t >> 3)] |= (unsigned char)(1u << (t & 7));
+            }
+        }
+    };
+    uint32_t turns = 1;
+    addPlane();
+    for (size_t i = 0; i < j.records.size(); ++i) {
+        const JournalRecord &rec = j.records[i];
+        Command cmd;
+        cmd.type = (CommandType)rec.type;
+        cmd.terr = rec.terr;
+        cmd.armies = rec.armies;
+        int player = replay.currentPlayer;
+        if (cmd.type == CMD_CLICK || !replay.apply(cmd)) {
+            err = "journal record " + std::to_string(i) + " was rejected";
+            return false;
+        }
+        if ((uint32_t)replay.rngCount != rec.rngCount) {
+            err = "journal record " + std::to_string(i) + ": dice diverged";
+            return false;
+        }
+        if (replay.currentPlayer != player && !replay.gameOver) {
+            ++turns;
+            addPlane();
+        }
+    }
+    hdr.turns = turns;
+    size_t journalAt = record.size();
+    packJournal(j, true, record);
+    hdr.journalBytes = (uint32_t)(record.size() - journalAt);
+    std::memcpy(record.data(), &hdr, sizeof(hdr));
+
+    if (segBytes > 0 && segBytes + record.size() > kSegmentBytes && !openSegment(segment + 1, err)) {
+        return false;
+    }
+    if (!writeAll(segFd, record.data(), record.size())) {
+        err = segmentPath(dir, segment) + ": cannot write";
+        return false;
+    }
+    e.gameId  = nextId;
+    e.segment = segment;
+    e.offset  = segBytes;
+    e.bytes   = (uint32_t)record.size();
+    e.turns   = turns;
+    e.winner  = (int8_t)(replay.gameOver ? replay.winner : -1);
+    segBytes += record.size();
+    if (!writeAll(indexFd, &e, sizeof(e))) {
+        err = dir + "/index.ridx: cannot write";
+        return false;
+    }
+    id = nextId++;
+    return true;
+}
+
+bool ArchiveWriter::sync() {
+    if (indexFd < 0) return false;
+    return fdatasync(segFd) == 0 && fdatasync(indexFd) == 0;
+}
+
+void ArchiveWriter::close() {
+    if (indexFd >= 0) {
+        if (!sync()) std::fprintf(stderr, "WARNING: archive sync failed\n");
+        ::close(indexFd);
+    }
+    if (segFd >= 0) ::close(segFd);
+    indexFd = segFd = -1;
+}
+
+// ---------------- index ----------------
+
+ArchiveIndex::~ArchiveIndex() {
+    if (mapped) munmap(mapped, mappedLen);
+}
+
+bool ArchiveIndex::open(const std::string &path, std::string &err) {
+    if (mapped) munmap(mapped, mappedLen);
+    mapped = nullptr;
+    entries = nullptr;
+    count = 0;
+    dir = path;
+    readBots(dir, botNames);
+
+    std::string indexPath = dir + "/index.ridx";
+    int fd = ::open(indexPath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        err = indexPath + ": cannot open";
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < kEntriesOffset) {
+        ::close(fd);
+        err = indexPath + ": not an archive index";
+        return false;
+    }
+    size_t len = (size_t)st.st_size;
+    void* base = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        err = indexPath + ": mmap failed";
+        return false;
+    }
+    IndexHeader hdr;
+    std::memcpy(&hdr, base, sizeof(hdr));
+    if (std::memcmp(hdr.magic, kMagic, sizeof(kMagic)) != 0 || hdr.version != kVersion ||
+        hdr.entryBytes != sizeof(ArchiveEntry)) {
+        munmap(base, len);
+        err = indexPath + ": not an archive index";
+        return false;
+    }
+    mapped = base;
+    mappedLen = len;
+    entries = (const ArchiveEntry*)((const unsigned char*)base + kEntriesOffset);
+    count = (len - kEntriesOffset) / sizeof(ArchiveEntry);
+    return true;
+}
+
+const ArchiveEntry* ArchiveIndex::find(uint64_t gameId) const {
+    const ArchiveEntry* it = std::lower_bound(entries, entries + count, gameId,
+        [](const ArchiveEntry &e, uint64_t id) { return e.gameId < id; });
+    return it != entries + count && it->gameId == gameId ? it : nullptr;
+}
+
+int ArchiveIndex::botId(const std::string &name) const {
+    for (size_t i = 0; i < botNames.size(); ++i) {
+        if (botNames[i] == name) return (int)i;
+    }
+    return -1;
+}
+
+bool ArchiveIndex::readJournal(const ArchiveEntry &e, Journal &j, std::string &err) const {
+    std::string path = segmentPath(dir, e.segment);
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        err = path + ": cannot open";
+        return false;
+    }
+    std::vector<unsigned char> data(e.bytes);
+    bool ok = pread(fd, data.data(), e.bytes, (off_t)e.offset) == (ssize_t)e.bytes;
+    ::close(fd);
+    GameRecordHeader hdr;
+    if (ok && e.bytes >= sizeof(hdr)) std::memcpy(&hdr, data.data(), sizeof(hdr));
+    uint64_t planes = ok && e.bytes >= sizeof(hdr) ? (uint64_t)hdr.turns * 2 * hdr.planeBytes : 0;
+    if (!ok || e.bytes < sizeof(hdr) || std::memcmp(hdr.magic, kRecordMagic, sizeof(kRecordMagic)) != 0 ||
+        sizeof(hdr) + planes + hdr.journalBytes > e.bytes) {
+        err = path + ": bad record for game " + std::to_string(e.gameId);
+        return false;
+    }
+    return parseJournal(data.data() + sizeof(hdr) + planes, hdr.journalBytes, j, err);
+}
+
+// ---------------- queries ----------------
+
+namespace {
+
+// a HeldTest as byte masks over the player's owner plane
+struct PlaneProbe {
+    uint32_t turn;
+    int player;
+    std::vector<uint32_t> byteAt;
+    std::vector<unsigned char> mask;
+};
+
+// the segment a query worker is reading, mapped whole; pages load on touch
+struct SegmentView {
+    uint32_t seg = UINT32_MAX;
+    void*    base = nullptr;
+    size_t   len = 0;
+
+    ~SegmentView() { release(); }
+    void release() {
+        if (base) munmap(base, len);
+        base = nullptr;
+        seg = UINT32_MAX;
+    }
+    bool map(const std::string &dir, uint32_t s) {
+        if (seg == s) return true;
+        release();
+        int fd = ::open(segmentPath(dir, s).c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0 && st.st_size > 0;
+        if (ok) {
+            len = (size_t)st.st_size;
+            base = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+            ok = base != MAP_FAILED;
+            if (!ok) base = nullptr;
+            // a probe reads a page or so per game; readahead would pull in
+            // the journals around it
+            else madvise(base, len, MADV_RANDOM);
+        }
+        ::close(fd);
+        if (ok) seg = s;
+        return ok;
+    }
+};
+
+bool indexMatch(const ArchiveEntry &e, const ArchiveQuery &q, uint32_t minTurns) {
+    if (q.gameId >= 0 && e.gameId != (uint64_t)q.gameId) return false;
+    if (!q.anySeed && e.seed != q.seed) return false;
+    if (q.mapFingerprint && e.mapFingerprint != q.mapFingerprint) return false;
+    if (q.winner != -2 && e.winner != q.winner) return false;
+    if (e.turns < minTurns || e.turns > q.maxTurns) return false;
+    if (e.actions < q.minActions || e.actions > q.maxActions) return false;
+    for (int p = 0; p < 2; ++p) {
+        if (q.bots[p] >= 0 && e.bots[p] != q.bots[p]) return false;
+    }
+    return true;
+}
+
+bool planesMatch(const ArchiveEntry &e, const unsigned char* rec, const std::vector<PlaneProbe> &probes) {
+    GameRecordHeader hdr;
+    std::memcpy(&hdr, rec, sizeof(hdr));
+    if (std::memcmp(hdr.magic, kRecordMagic, sizeof(kRecordMagic)) != 0) return false;
+    if (sizeof(hdr) + hdr.journalBytes + (uint64_t)hdr.turns * 2 * hdr.planeBytes > e.bytes) return false;
+    const unsigned char* planes = rec + sizeof(hdr);
+    for (const PlaneProbe &p : probes) {
+        if (p.turn < 1 || p.turn > hdr.turns) return false;
+        const unsigned char* plane = planes + ((size_t)(p.turn - 1) * 2 + p.player) * hdr.planeBytes;
+        for (size_t k = 0; k < p.byteAt.size(); ++k) {
+            if (p.byteAt[k] >= hdr.planeBytes) return false;
+            if ((plane[p.byteAt[k]] & p.mask[k]) != p.mask[k]) return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool runQuery(const ArchiveIndex &idx, const ArchiveQuery &q, int threads,
+              std::vector<uint64_t> &ids, QueryStats &stats, std::string &err) {
+    ids.clear();
+    stats = QueryStats();
+    stats.entries = idx.size();
+
+    // turn counts in the index rule out games too short for a held test
+    uint32_t minTurns = q.minTurns;
+    std::vector<PlaneProbe> probes;
+    for (const HeldTest &h : q.held) {
+        if (h.player < 0 || h.player > 1) {
+            err = "held: player must be 0 or 1";
+            return false;
+        }
+        minTurns = std::max(minTurns, h.turn);
+        std::vector<uint32_t> terrs = h.terrs;
+        std::sort(terrs.begin(), terrs.end());
+        PlaneProbe p;
+        p.turn = h.turn;
+        p.player = h.player;
+        for (uint32_t t : terrs) {
+            uint32_t byte = t >> 3;
+            if (p.byteAt.empty() || p.byteAt.back() != byte) {
+                p.byteAt.push_back(byte);
+                p.mask.push_back(0);
+            }
+            p.mask.back() |= (unsigned char)(1u << (t & 7));
+        }
+        probes.push_back(p);
+    }
+
+    // a game id narrows the scan to one entry
+    size_t first = 0, last = idx.size();
+    if (q.gameId >= 0) {
+        const ArchiveEntry* e = idx.find((uint64_t)q.gameId);
+        first = e ? (size_t)(e - &idx[0]) : 0;
+        last = e ? first + 1 : 0;
+    }
+
+    size_t chunks = (last - first + kChunkEntries - 1) / kChunkEntries;
+    std::vector<std::vector<uint64_t>> found(chunks);
+    std::atomic<size_t> nextChunk(0), candidates(0);
+    std::mutex errMutex;
+    bool failed = false;
+
+    auto worker = [&]() {
+        SegmentView view;
+        size_t c;
+        while ((c = nextChunk++) < chunks) {
+            size_t lo = first + c * kChunkEntries;
+            size_t hi = std::min(last, lo + kChunkEntries);
+            size_t passed = 0;
+            for (size_t i = lo; i < hi; ++i) {
+                const ArchiveEntry &e = idx[i];
+                if (!indexMatch(e, q, minTurns)) continue;
+                ++passed;
+                if (!probes.empty()) {
+                    if (!view.map(idx.directory(), e.segment) || e.offset + e.bytes > view.len) {
+                        std::lock_guard<std::mutex> lock(errMutex);
+                        failed = true;
+                        err = segmentPath(idx.directory(), e.segment) + ": missing data for game " +
+                              std::to_string(e.gameId);
+                        continue;
+                    }
+                    if (!planesMatch(e, (const unsigned char*)view.base + e.offset, probes)) continue;
+                }
+                found[c].push_back(e.gameId);
+            }
+            candidates += passed;
+        }
+    };
+    if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+    threads = std::max(1, std::min(threads, (int)chunks));
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threads; ++i) pool.emplace_back(worker);
+    worker();
+    for (std::thread &t : pool) t.join();
+
+    // chunks are in index order, and ids ascend through the index
+    for (const std::vector<uint64_t> &f : found) ids.insert(ids.end(), f.begin(), f.end());
+    stats.candidates = candidates;
+    stats.matches = ids.size();
+    return !failed;
+}
@@ -0,0 +1,139 @@
+// archive.h
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "game.h"
+#include "journal.h"
+
+// Replay archive: a directory of append-only segment files holding
+// finished journals, and one index file of fixed-size entries that
+// queries map and filter before any segment is read.
+//
+//   index.ridx      header, then one ArchiveEntry per game in id order
+//   bots.txt        bot names, one per line; entries refer to them by line
+//   seg-NNNNNN.rseg game records, see archive.cpp
+//
+// Beside each journal a game record keeps the owners at the start of every
+// turn, a plane of one bit per territory for each player, so questions
+// about who held what and when are a bit test instead of a replay; a
+// territory neither holds is in neither plane. Turns count each player's
+// turn from 1, starting where the journal starts.
+
+struct ArchiveEntry {
+    uint64_t gameId;
+    uint64_t seed;           // Game::rngSeed at the start
+    uint64_t mapFingerprint;
+    uint64_t offset;         // of the game record in its segment
+    uint32_t segment;
+    uint32_t bytes;          // of the game record
+    uint32_t turns;          // turns started, so owner plane pairs stored
+    uint32_t actions;        // journal records
+    uint16_t bots[2];        // per player, into bots.txt
+    int8_t   winner;         // -1 unfinished
+    uint8_t  pad[11];
+};
+
+// Appends games. Each game's record goes to the open segment before its
+// index entry, and open() drops index entries whose record never made it,
+// so a crash loses at most the games in flight.
+class ArchiveWriter {
+public:
+    static const uint64_t kSegmentBytes = 256ull << 20; // then a new segment
+
+    ArchiveWriter() = default;
+    ~ArchiveWriter();
+    ArchiveWriter(const ArchiveWriter&) = delete;
+    ArchiveWriter& operator=(const ArchiveWriter&) = delete;
+
+    // creates dir if needed
+    bool open(const std::string &dir, std::string &err);
+
+    // onMap supplies the map the journal was played on; replays it for the
+    // outcome and owner planes
+    bool add(const Game &onMap, const Journal &j, const std::string bots[2],
+             uint64_t &id, std::string &err);
+
+    bool sync(); // segment, then index, to disk
+    void close();
+
+private:
+    std::string dir;
+    int indexFd = -1;
+    int segFd = -1;
+    uint32_t segment = 0;
+    uint64_t segBytes = 0;
+    uint64_t nextId = 1;
+    std::vector<std::string> botNames;
+
+    Game replay;                       // scratch, keeps its buffers
+    std::vector<unsigned char> record; // scratch
+
+    bool openSegment(uint32_t seg, std::string &err);
+    int  botId(const std::string &name, std::string &err);
+};
+
+// The index, mapped read-only.
+class ArchiveIndex {
+public:
+    ArchiveIndex() = default;
+    ~ArchiveIndex();
+    ArchiveIndex(const ArchiveIndex&) = delete;
+    ArchiveIndex& operator=(const ArchiveIndex&) = delete;
+
+    bool open(const std::string &dir, std::string &err);
+
+    const std::string &directory() const { return dir; }
+    size_t size() const { return count; }
+    const ArchiveEntry &operator[](size_t i) const { return entries[i]; }
+    const ArchiveEntry* find(uint64_t gameId) const; // ids ascend
+    const std::vector<std::string> &bots() const { return botNames; }
+    int botId(const std::string &name) const; // -1 if unknown
+
+    // the game's journal, straight from its segment
+    bool readJournal(const ArchiveEntry &e, Journal &j, std::string &err) const;
+
+private:
+    std::string dir;
+    void*  mapped = nullptr;
+    size_t mappedLen = 0;
+    const ArchiveEntry* entries = nullptr;
+    size_t count = 0;
+    std::vector<std::string> botNames;
+};
+
+// player held every one of terrs at the start of turn
+struct HeldTest {
+    int player;
+    uint32_t turn;
+    std::vector<uint32_t> terrs;
+};
+
+// All given conditions must hold. The index fields are checked first;
+// only games that pass them have their segment pages touched.
+struct ArchiveQuery {
+    int64_t  gameId = -1;          // -1 any
+    bool     anySeed = true;
+    uint64_t seed = 0;
+    uint64_t mapFingerprint = 0;   // 0 any
+    int      winner = -2;          // -2 any, -1 unfinished
+    uint32_t minTurns = 0, maxTurns = UINT32_MAX;
+    uint32_t minActions = 0, maxActions = UINT32_MAX;
+    int      bots[2] = {-1, -1};   // bot id per player, -1 any
+    std::vector<HeldTest> held;
+};
+
+struct QueryStats {
+    size_t entries = 0;    // in the index
+    size_t candidates = 0; // passed the index fields
+    size_t matches = 0;
+};
+
+// matching game ids in ascending order; threads <= 0 uses every core
+bool runQuery(const ArchiveIndex &idx, const ArchiveQuery &q, int threads,
+              std::vector<uint64_t> &ids, QueryStats &stats, std::string &err);
+
+#endif
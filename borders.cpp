@@ -0,0 +1,103 @@
+// borders.cpp
+#include "borders.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+// world units; lon/lat text round-trips stay well inside this
+const float kEps = 1e-5f;
+
+struct Seg {
+    float x0, y0, x1, y1;
+    int terr;
+};
+
+// b runs over the same two vertices as a, however short, or lies along
+// a's line and the two overlap by more than kEps
+bool sharesBorder(const Seg &a, const Seg &b) {
+    if (a.x0 == b.x1 && a.y0 == b.y1 && a.x1 == b.x0 && a.y1 == b.y0) return a.x0 != a.x1 || a.y0 != a.y1;
+    if (a.x0 == b.x0 && a.y0 == b.y0 && a.x1 == b.x1 && a.y1 == b.y1) return a.x0 != a.x1 || a.y0 != a.y1;
+    float dx = a.x1 - a.x0, dy = a.y1 - a.y0;
+    float len = std::sqrt(dx*dx + dy*dy);
+    if (len < kEps) return false;
+    float ux = dx / len, uy = dy / len;
+    float bx0 = b.x0 - a.x0, by0 = b.y0 - a.y0;
+    float bx1 = b.x1 - a.x0, by1 = b.y1 - a.y0;
+    if (std::fabs(ux * by0 - uy * bx0) > kEps || std::fabs(ux * by1 - uy * bx1) > kEps) return false;
+    float t0 = ux * bx0 + uy * by0;
+    float t1 = ux * bx1 + uy * by1;
+    float lo = std::max(0.0f, std::min(t0, t1));
+    float hi = std::min(len, std::max(t0, t1));
+    return hi - lo > kEps;
+}
+
+} // namespace
+
+void findSharedBorders(const MapSource &src, std::vector<std::pair<int,int>> &pairs) {
+    pairs.clear();
+    std::vector<Seg> segs;
+    float minX = 0, minY = 0, maxX = 0, maxY = 0;
+    double sumLen = 0;
+    for (int t = 0; t < (int)src.terrs.size(); ++t) {
+        const TerritorySource &ts = src.terrs[t];
+        int n = (int)ts.polyX.size();
+        for (int i = 0, j = n - 1; i < n; j = i++) {
+            Seg s = {ts.polyX[j], ts.polyY[j], ts.polyX[i], ts.polyY[i], t};
+            if (segs.empty()) { minX = maxX = s.x0; minY = maxY = s.y0; }
+            minX = std::min(minX, std::min(s.x0, s.x1)); maxX = std::max(maxX, std::max(s.x0, s.x1));
+            minY = std::min(minY, std::min(s.y0, s.y1)); maxY = std::max(maxY, std::max(s.y0, s.y1));
+            sumLen += std::fabs(s.x1 - s.x0) + std::fabs(s.y1 - s.y0);
+            segs.push_back(s);
+        }
+    }
+    if (segs.empty()) return;
+
+    // cells about one average edge across; each edge goes in every cell its
+    // (slightly grown) box touches, so overlapping edges meet in some cell
+    float spanX = std::max(maxX - minX, 1e-6f), spanY = std::max(maxY - minY, 1e-6f);
+    float cell = std::max((float)(sumLen / segs.size()), std::max(spanX, spanY) / 4096.0f);
+    int nx = std::max(1, std::min(4096, (int)std::ceil(spanX / cell)));
+    int ny = std::max(1, std::min(4096, (int)std::ceil(spanY / cell)));
+    float invW = nx / spanX, invH = ny / spanY;
+    auto cellRange = [&](const Seg &s, int &cx0, int &cy0, int &cx1, int &cy1) {
+        cx0 = std::max(0, std::min(nx-1, (int)((std::min(s.x0, s.x1) - kEps - minX) * invW)));
+        cx1 = std::max(0, std::min(nx-1, (int)((std::max(s.x0, s.x1) + kEps - minX) * invW)));
+        cy0 = std::max(0, std::min(ny-1, (int)((std::min(s.y0, s.y1) - kEps - minY) * invH)));
+        cy1 = std::max(0, std::min(ny-1, (int)((std::max(s.y0, s.y1) + kEps - minY) * invH)));
+    };
+
+    // count, prefix-sum, fill, as SpatialGrid does
+    std::vector<uint32_t> cellStart((size_t)nx * ny + 1, 0);
+    for (const Seg &s : segs) {
+        int cx0, cy0, cx1, cy1;
+        cellRange(s, cx0, cy0, cx1, cy1);
+        for (int cy = cy0; cy <= cy1; ++cy)
+            for (int cx = cx0; cx <= cx1; ++cx) cellStart[(size_t)cy * nx + cx + 1]++;
+    }
+    for (size_t c = 1; c < cellStart.size(); ++c) cellStart[c] += cellStart[c-1];
+    std::vector<uint32_t> items(cellStart.back());
+    std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+    for (uint32_t e = 0; e < (uint32_t)segs.size(); ++e) {
+        int cx0, cy0, cx1, cy1;
+        cellRange(segs[e], cx0, cy0, cx1, cy1);
+        for (int cy = cy0; cy <= cy1; ++cy)
+            for (int cx = cx0; cx <= cx1; ++cx) items[fill[(size_t)cy * nx + cx]++] = e;
+    }
+
+    for (size_t c = 0; c + 1 < cellStart.size(); ++c) {
+        for (uint32_t i = cellStart[c]; i < cellStart[c+1]; ++i) {
+            const Seg &a = segs[items[i]];
+            for (uint32_t j = i + 1; j < cellStart[c+1]; ++j) {
+                const Seg &b = segs[items[j]];
+                if (a.terr == b.terr) continue;
+                if (sharesBorder(a, b) || sharesBorder(b, a)) {
+                    pairs.push_back({std::min(a.terr, b.terr), std::max(a.terr, b.terr)});
+                }
+            }
+        }
+    }
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+}
@@ -0,0 +1,17 @@
+// borders.h
+#ifndef BORDERS_H
+#define BORDERS_H
+
+#include <utility>
+#include <vector>
+#include "map.h"
+
+// Territory pairs (a < b, sorted, unique) whose outlines share a stretch of
+// border: two edges with the same endpoints, or on the same line and
+// overlapping by more than a hair.
+// Touching at a single point does not count. Edges are bucketed in a
+// uniform grid, so the cost is linear in the number of edges for maps
+// whose edges are of similar length.
+void findSharedBorders(const MapSource &src, std::vector<std::pair<int,int>> &pairs);
+
+#endif
@@ -0,0 +1,440 @@
+// deflate.cpp
+#include "deflate.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <queue>
+
+namespace {
+
+const int kWindow    = 32768;
+const int kMinMatch  = 3;
+const int kMaxMatch  = 258;
+const int kMaxChain  = 64;       // candidates tried per position
+const int kHashBits  = 15;
+const size_t kBlockSymbols = 1 << 16; // a new Huffman table after this many
+
+const int kLenBase[29]  = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,
+                           67,83,99,115,131,163,195,227,258};
+const int kLenExtra[29] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+const int kDistBase[30] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,
+                           1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+const int kDistExtra[30] = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+const int kClenOrder[19] = {16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15};
+
+// literal (dist 0) or match
+struct Symbol {
+    uint16_t litlen;
+    uint16_t dist;
+};
+
+int lengthCode(int len) {
+    int c = 28;
+    while (kLenBase[c] > len) --c;
+    return c;
+}
+
+int distCode(int dist) {
+    int c = 29;
+    while (kDistBase[c] > dist) --c;
+    return c;
+}
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<unsigned char> &o) : out(o) {}
+    void put(uint32_t bits, int n) {
+        acc |= (uint64_t)bits << fill;
+        fill += n;
+        while (fill >= 8) {
+            out.push_back((unsigned char)acc);
+            acc >>= 8;
+            fill -= 8;
+        }
+    }
+    void finish() {
+        if (fill > 0) out.push_back((unsigned char)acc);
+        acc = 0;
+        fill = 0;
+    }
+private:
+    std::vector<unsigned char> &out;
+    uint64_t acc = 0;
+    int fill = 0;
+};
+
+// Huffman code lengths no longer than limit; when the tree comes out too
+// deep the counts are flattened and it is built again
+void buildLengths(const std::vector<uint32_t> &freq, int limit, std::vector<uint8_t> &len) {
+    size_t n = freq.size();
+    len.assign(n, 0);
+    std::vector<uint32_t> f = freq;
+    for (;;) {
+        struct Item { uint64_t w; int node; };
+        auto heavier = [](const Item &a, const Item &b) { return a.w > b.w; };
+        std::priority_queue<Item, std::vector<Item>, decltype(heavier)> heap(heavier);
+        std::vector<int> parent;
+        for (size_t s = 0; s < n; ++s) {
+            if (f[s] == 0) continue;
+            heap.push({f[s], (int)parent.size()});
+            parent.push_back(-1);
+        }
+        std::vector<int> leafOf(parent.size());
+        for (size_t s = 0, k = 0; s < n; ++s) if (f[s]) leafOf[k++] = (int)s;
+        size_t leaves = parent.size();
+        if (leaves == 0) return;
+        if (leaves == 1) { // a lone code still needs one bit
+            len[leafOf[0]] = 1;
+            return;
+        }
+        while (heap.size() > 1) {
+            Item a = heap.top(); heap.pop();
+            Item b = heap.top(); heap.pop();
+            int node = (int)parent.size();
+            parent.push_back(-1);
+            parent[a.node] = parent[b.node] = node;
+            heap.push({a.w + b.w, node});
+        }
+        int deepest = 0;
+        for (size_t k = 0; k < leaves; ++k) {
+            int d = 0;
+            for (int p = parent[k]; p >= 0; p = parent[p]) ++d;
+            len[leafOf[k]] = (uint8_t)d;
+            deepest = std::max(deepest, d);
+        }
+        if (deepest <= limit) return;
+        for (uint32_t &x : f) if (x) x = (x >> 1) | 1;
+    }
+}
+
+// canonical codes, bit-reversed for the LSB-first stream
+void buildCodes(const std::vector<uint8_t> &len, std::vector<uint16_t> &code) {
+    int count[16] = {}, next[16] = {};
+    for (uint8_t l : len) count[l]++;
+    count[0] = 0;
+    for (int b = 1, c = 0; b < 16; ++b) {
+        c = (c + count[b-1]) << 1;
+        next[b] = c;
+    }
+    code.assign(len.size(), 0);
+    for (size_t s = 0; s < len.size(); ++s) {
+        int l = len[s];
+        if (!l) continue;
+        uint32_t c = (uint32_t)next[l]++, r = 0;
+        for (int i = 0; i < l; ++i) r |= ((c >> i) & 1) << (l - 1 - i);
+        code[s] = (uint16_t)r;
+    }
+}
+
+void writeBlock(BitWriter &bw, const Symbol* syms, size_t count, bool last) {
+    std::vector<uint32_t> litFreq(286, 0), distFreq(30, 0);
+    for (size_t i = 0; i < count; ++i) {
+        if (syms[i].dist == 0) {
+            litFreq[syms[i].litlen]++;
+        } else {
+            litFreq[257 + lengthCode(syms[i].litlen)]++;
+            distFreq[distCode(syms[i].dist)]++;
+        }
+    }
+    litFreq[256] = 1;
+    // two distance codes keep the tree complete even with no matches
+    if (std::count_if(distFreq.begin(), distFreq.end(), [](uint32_t f) { return f > 0; }) < 2) {
+        distFreq[0] |= 1;
+        distFreq[1] |= 1;
+    }
+
+    std::vector<uint8_t> litLen, distLen;
+    buildLengths(litFreq, 15, litLen);
+    buildLengths(distFreq, 15, distLen);
+    int hlit = 286, hdist = 30;
+    while (hlit > 257 && litLen[hlit-1] == 0) --hlit;
+    while (hdist > 1 && distLen[hdist-1] == 0) --hdist;
+
+    // both length lists run-length coded with the code length alphabet
+    std::vector<uint8_t> all(litLen.begin(), litLen.begin() + hlit);
+    all.insert(all.end(), distLen.begin(), distLen.begin() + hdist);
+    struct Run { uint8_t sym, extra; };
+    std::vector<Run> runs;
+    std::vector<uint32_t> clFreq(19, 0);
+    for (size_t i = 0; i < all.size(); ) {
+        uint8_t v = all[i];
+        size_t j = i;
+        while (j < all.size() && all[j] == v) ++j;
+        size_t run = j - i;
+        if (v == 0) {
+            while (run >= 11) { size_t r = std::min<size_t>(run, 138); runs.push_back({18, (uint8_t)(r - 11)}); run -= r; }
+            if (run >= 3) { runs.push_back({17, (uint8_t)(run - 3)}); run = 0; }
+        } else {
+            runs.push_back({v, 0});
+            --run;
+            while (run >= 3) { size_t r = std::min<size_t>(run, 6); runs.push_back({16, (uint8_t)(r - 3)}); run -= r; }
+        }
+        while (run-- > 0) runs.push_back({v, 0});
+        i = j;
+    }
+    for (const Run &r : runs) clFreq[r.sym]++;
+    std::vector<uint8_t> clLen;
+    std::vector<uint16_t> clCode, litCode, distCode_;
+    buildLengths(clFreq, 7, clLen);
+    buildCodes(clLen, clCode);
+    buildCodes(litLen, litCode);
+    buildCodes(distLen, distCode_);
+    int hclen = 19;
+    while (hclen > 4 && clLen[kClenOrder[hclen-1]] == 0) --hclen;
+
+    bw.put(last ? 1 : 0, 1);
+    bw.put(2, 2); // dynamic Huffman
+    bw.put((uint32_t)(hlit - 257), 5);
+    bw.put((uint32_t)(hdist - 1), 5);
+    bw.put((uint32_t)(hclen - 4), 4);
+    for (int i = 0; i < hclen; ++i) bw.put(clLen[kClenOrder[i]], 3);
+    for (const Run &r : runs) {
+        bw.put(clCode[r.sym], clLen[r.sym]);
+        if (r.sym == 16) bw.put(r.extra, 2);
+        if (r.sym == 17) bw.put(r.extra, 3);
+        if (r.sym == 18) bw.put(r.extra, 7);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        const Symbol &s = syms[i];
+        if (s.dist == 0) {
+            bw.put(litCode[s.litlen], litLen[s.litlen]);
+            continue;
+        }
+        int lc = lengthCode(s.litlen), dc = distCode(s.dist);
+        bw.put(litCode[257 + lc], litLen[257 + lc]);
+        bw.put((uint32_t)(s.litlen - kLenBase[lc]), kLenExtra[lc]);
+        bw.put(distCode_[dc], distLen[dc]);
+        bw.put((uint32_t)(s.dist - kDistBase[dc]), kDistExtra[dc]);
+    }
+    bw.put(litCode[256], litLen[256]);
+}
+
+// Canonical Huffman decoding table: codes per length, then symbols in
+// code order. Decoding walks one bit at a time, so no table is indexed
+// by bits the stream chose.
+struct Decoder {
+    uint16_t count[16];
+    uint16_t symbol[288];
+};
+
+// false on an over-subscribed set of lengths; an incomplete one is fine,
+// its unused codes fail when they turn up
+bool buildDecoder(Decoder &d, const uint8_t* len, int n) {
+    std::memset(d.count, 0, sizeof(d.count));
+    for (int s = 0; s < n; ++s) d.count[len[s]]++;
+    int left = 1;
+    for (int l = 1; l < 16; ++l) {
+        left = (left << 1) - d.count[l];
+        if (left < 0) return false;
+    }
+    uint16_t offset[16];
+    offset[1] = 0;
+    for (int l = 1; l < 15; ++l) offset[l+1] = (uint16_t)(offset[l] + d.count[l]);
+    for (int s = 0; s < n; ++s) if (len[s]) d.symbol[offset[len[s]]++] = (uint16_t)s;
+    return true;
+}
+
+class BitReader {
+public:
+    BitReader(const unsigned char* p, const unsigned char* e) : at(p), end(e) {}
+    bool bits(int n, uint32_t &v) {
+        while (fill < n) {
+            if (at == end) return false;
+            acc |= (uint32_t)*at++ << fill;
+            fill += 8;
+        }
+        v = acc & ((1u << n) - 1);
+        acc >>= n;
+        fill -= n;
+        return true;
+    }
+    // -1 for a code the table does not have, or the end of the input
+    int decode(const Decoder &d) {
+        int code = 0, first = 0, index = 0;
+        for (int l = 1; l < 16; ++l) {
+            uint32_t b;
+            if (!bits(1, b)) return -1;
+            code |= (int)b;
+            int n = d.count[l];
+            if (code - n < first) return d.symbol[index + (code - first)];
+            index += n;
+            first = (first + n) << 1;
+            code <<= 1;
+        }
+        return -1;
+    }
+    // stored blocks start on a byte
+    void align() { acc = 0; fill = 0; }
+    const unsigned char* at;
+    const unsigned char* end;
+private:
+    uint32_t acc = 0;
+    int fill = 0;
+};
+
+bool readDynamic(BitReader &br, Decoder &lit, Decoder &dist) {
+    uint32_t hlit, hdist, hclen;
+    if (!br.bits(5, hlit) || !br.bits(5, hdist) || !br.bits(4, hclen)) return false;
+    hlit += 257;
+    hdist += 1;
+    hclen += 4;
+    if (hlit > 286 || hdist > 30) return false;
+
+    uint8_t len[286 + 30] = {};
+    for (uint32_t i = 0; i < hclen; ++i) {
+        uint32_t v;
+        if (!br.bits(3, v)) return false;
+        len[kClenOrder[i]] = (uint8_t)v;
+    }
+    Decoder cl;
+    if (!buildDecoder(cl, len, 19)) return false;
+    std::memset(len, 0, 19);
+
+    uint32_t n = 0;
+    while (n < hlit + hdist) {
+        int sym = br.decode(cl);
+        if (sym < 0) return false;
+        if (sym < 16) {
+            len[n++] = (uint8_t)sym;
+            continue;
+        }
+        uint32_t repeat;
+        uint8_t v = 0;
+        if (sym == 16) {
+            if (n == 0 || !br.bits(2, repeat)) return false;
+            v = len[n-1];
+            repeat += 3;
+        } else if (sym == 17) {
+            if (!br.bits(3, repeat)) return false;
+            repeat += 3;
+        } else {
+            if (!br.bits(7, repeat)) return false;
+            repeat += 11;
+        }
+        if (n + repeat > hlit + hdist) return false;
+        while (repeat--) len[n++] = v;
+    }
+    return len[256] != 0 && buildDecoder(lit, len, (int)hlit) &&
+           buildDecoder(dist, len + hlit, (int)hdist);
+}
+
+} // namespace
+
+void deflateRaw(const unsigned char* data, size_t len, std::vector<unsigned char> &out) {
+    // greedy matching; chains link positions with the same 3-byte hash
+    std::vector<Symbol> syms;
+    syms.reserve(len / 2 + 16);
+    std::vector<int32_t> head(1 << kHashBits, -1), prev(kWindow, -1);
+    auto hash = [&](size_t i) {
+        uint32_t v = (uint32_t)data[i] | (uint32_t)data[i+1] << 8 | (uint32_t)data[i+2] << 16;
+        return (v * 2654435761u) >> (32 - kHashBits);
+    };
+    auto insert = [&](size_t i) {
+        if (i + kMinMatch > len) return;
+        uint32_t h = hash(i);
+        prev[i & (kWindow - 1)] = head[h];
+        head[h] = (int32_t)i;
+    };
+    for (size_t i = 0; i < len; ) {
+        int bestLen = 0, bestDist = 0;
+        if (i + kMinMatch <= len) {
+            int32_t cand = head[hash(i)];
+            int maxLen = (int)std::min<size_t>(kMaxMatch, len - i);
+            for (int tries = 0; cand >= 0 && i - cand <= (size_t)kWindow && tries < kMaxChain; ++tries) {
+                const unsigned char* a = data + cand;
+                const unsigned char* b = data + i;
+                if (a[bestLen] == b[bestLen]) {
+                    int l = 0;
+                    while (l < maxLen && a[l] == b[l]) ++l;
+                    if (l > bestLen) {
+                        bestLen = l;
+                        bestDist = (int)(i - cand);
+                        if (l == maxLen) break;
+                    }
+                }
+                int32_t next = prev[cand & (kWindow - 1)];
+                if (next >= cand) break; // slot reused by a newer position
+                cand = next;
+            }
+        }
+        if (bestLen >= kMinMatch) {
+            syms.push_back({(uint16_t)bestLen, (uint16_t)bestDist});
+            for (int k = 0; k < bestLen; ++k) insert(i + k);
+            i += bestLen;
+        } else {
+            syms.push_back({data[i], 0});
+            insert(i);
+            ++i;
+        }
+    }
+
+    BitWriter bw(out);
+    size_t at = 0;
+    do {
+        size_t n = std::min(kBlockSymbols, syms.size() - at);
+        writeBlock(bw, syms.data() + at, n, at + n == syms.size());
+        at += n;
+    } while (at < syms.size());
+    bw.finish();
+}
+
+bool inflateRaw(const unsigned char* data, size_t len, size_t maxOut, std::vector<unsigned char> &out) {
+    size_t start = out.size();
+    BitReader br(data, data + len);
+    Decoder fixedLit, fixedDist, lit, dist;
+    uint8_t fixedLen[288];
+    std::fill(fixedLen, fixedLen + 144, 8);
+    std::fill(fixedLen + 144, fixedLen + 256, 9);
+    std::fill(fixedLen + 256, fixedLen + 280, 7);
+    std::fill(fixedLen + 280, fixedLen + 288, 8);
+    buildDecoder(fixedLit, fixedLen, 288);
+    std::fill(fixedLen, fixedLen + 30, 5);
+    buildDecoder(fixedDist, fixedLen, 30);
+
+    uint32_t last;
+    do {
+        uint32_t type;
+        if (!br.bits(1, last) || !br.bits(2, type) || type == 3) return false;
+        if (type == 0) {
+            br.align();
+            if (br.end - br.at < 4) return false;
+            size_t n = br.at[0] | br.at[1] << 8;
+            size_t check = br.at[2] | br.at[3] << 8;
+            if (check != (~n & 0xffff)) return false;
+            br.at += 4;
+            if ((size_t)(br.end - br.at) < n || out.size() - start + n > maxOut) return false;
+            out.insert(out.end(), br.at, br.at + n);
+            br.at += n;
+            continue;
+        }
+        if (type == 2 && !readDynamic(br, lit, dist)) return false;
+        const Decoder &l = type == 1 ? fixedLit : lit;
+        const Decoder &d = type == 1 ? fixedDist : dist;
+        for (;;) {
+            int sym = br.decode(l);
+            if (sym < 0 || sym > 285) return false;
+            if (sym == 256) break;
+            if (sym < 256) {
+                if (out.size() - start >= maxOut) return false;
+                out.push_back((unsigned char)sym);
+                continue;
+            }
+            uint32_t extra, dextra;
+            int lc = sym - 257;
+            if (!br.bits(kLenExtra[lc], extra)) return false;
+            size_t n = kLenBase[lc] + extra;
+            int dc = br.decode(d);
+            if (dc < 0 || dc > 29 || !br.bits(kDistExtra[dc], dextra)) return false;
+            size_t back = kDistBase[dc] + dextra;
+            if (back > out.size() - start || out.size() - start + n > maxOut) return false;
+            size_t from = out.size() - back;
+            for (size_t k = 0; k < n; ++k) {
+                unsigned char c = out[from + k]; // push_back may move out
+                out.push_back(c);
+            }
+        }
+    } while (!last);
+    return true;
+}
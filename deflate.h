@@ -0,0 +1,20 @@
+// deflate.h
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <cstddef>
+#include <vector>
+
+// Raw DEFLATE (RFC 1951, no zlib header) for data this program writes
+// itself: greedy LZ77 over hash chains, then dynamic Huffman blocks.
+// Appends to out.
+void deflateRaw(const unsigned char* data, size_t len, std::vector<unsigned char> &out);
+
+// The other direction, for any raw DEFLATE stream, including one from a
+// file nobody vouches for: every code, length and distance is checked, so
+// a corrupt or hostile stream fails instead of reading or writing out of
+// bounds. Appends at most maxOut bytes to out; false if the stream is
+// malformed or truncated, or would inflate past that.
+bool inflateRaw(const unsigned char* data, size_t len, size_t maxOut, std::vector<unsigned char> &out);
+
+#endif
@@ -0,0 +1,345 @@
+// distance.cpp
+#include "distance.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char     kMagic[8] = {'R','I','S','K','D','S','T','1'};
+const uint32_t kVersion  = 2; // 2: component labels with landmarks
+const size_t   kDataOffset = 64; // table data starts here in the cache
+
+struct CacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t numTerrs;
+    uint32_t width;
+    uint32_t numLandmarks;
+    uint64_t graphHash; // adjacency the table was built from
+    int64_t  srcSize;   // stamp of the map file
+    int64_t  srcMtime;  // nanoseconds
+};
+
+bool statFile(const char* path, long long &size, long long &mtime) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    size  = (long long)st.st_size;
+    mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    return true;
+}
+
+// FNV-1a over the CSR adjacency
+uint64_t graphHash(const MapData &m) {
+    uint64_t h = 1469598103934665603ULL;
+    auto mix = [&h](const void* p, size_t len) {
+        const unsigned char* b = (const unsigned char*)p;
+        for (size_t i = 0; i < len; ++i) h = (h ^ b[i]) * 1099511628211ULL;
+    };
+    mix(&m.numTerrs, sizeof(m.numTerrs));
+    mix(m.adjStart.ptr, m.adjStart.count * sizeof(uint32_t));
+    mix(m.adjList.ptr, m.adjList.count * sizeof(uint32_t));
+    return h;
+}
+
+// BFS levels from s into territories still at -1; returns the deepest
+// level, and queue starts with the territories reached
+int bfs(const MapData &m, int s, std::vector<int32_t> &level, std::vector<uint32_t> &queue,
+        size_t* reached = nullptr) {
+    size_t head = 0, tail = 0;
+    level[s] = 0;
+    queue[tail++] = (uint32_t)s;
+    int deepest = 0;
+    while (head < tail) {
+        uint32_t u = queue[head++];
+        int next = level[u] + 1;
+        for (uint32_t k = m.adjStart[u]; k < m.adjStart[u+1]; ++k) {
+            uint32_t v = m.adjList[k];
+            if (level[v] >= 0) continue;
+            level[v] = next;
+            deepest = next;
+            queue[tail++] = v;
+        }
+    }
+    if (reached) *reached = tail;
+    return deepest;
+}
+
+// Matrix rows, sources handed out first-come first-served. The first hop
+// is the slot of the neighbor of s the path leaves through, inherited
+// from the parent beyond the first ring.
+template <typename T>
+void fillRows(const MapData &m, T* dist, T* hop, std::atomic<int> &nextSource) {
+    const int n = (int)m.numTerrs;
+    const T none = (T)~T(0);
+    std::vector<uint32_t> queue(n);
+    for (int s; (s = nextSource++) < n; ) {
+        T* d = dist + (size_t)s * n;
+        T* h = hop + (size_t)s * n;
+        std::fill(d, d + n, none);
+        std::fill(h, h + n, none);
+        size_t head = 0, tail = 0;
+        d[s] = 0;
+        queue[tail++] = (uint32_t)s;
+        while (head < tail) {
+            uint32_t u = queue[head++];
+            T next = (T)(d[u] + 1);
+            for (uint32_t k = m.adjStart[u]; k < m.adjStart[u+1]; ++k) {
+                uint32_t v = m.adjList[k];
+                if (d[v] != none) continue;
+                d[v] = next;
+                h[v] = (int)u == s ? (T)(k - m.adjStart[u]) : h[u];
+                queue[tail++] = v;
+            }
+        }
+    }
+}
+
+} // namespace
+
+std::string distCachePath(const char* mapPath) {
+    return std::string(mapPath) + ".dist";
+}
+
+DistanceTable::~DistanceTable() {
+    release();
+}
+
+void DistanceTable::release() {
+    if (mapped) munmap(mapped, mappedLen);
+    mapped = nullptr;
+    mappedLen = 0;
+    owned.clear();
+    owned.shrink_to_fit();
+    dist = hop = nullptr;
+    component = nullptr;
+    lmDist = nullptr;
+    dataLen = 0;
+    fromCache = false;
+}
+
+void DistanceTable::bindData(const uint8_t* data) {
+    if (numLandmarks == 0) {
+        dist = data;
+        hop = data + (size_t)n * n * width;
+        dataLen = (size_t)n * n * width * 2;
+    } else {
+        component = (const uint32_t*)data;
+        lmDist = (const uint16_t*)(data + (size_t)n * sizeof(uint32_t));
+        dataLen = (size_t)n * (sizeof(uint32_t) + numLandmarks * sizeof(uint16_t));
+    }
+}
+
+void DistanceTable::build(const MapData &m, int threads, size_t maxBytes) {
+    release();
+    map = &m;
+    n = (int)m.numTerrs;
+
+    // entries must stay below the "none" value: the diameter is at most
+    // twice the eccentricity of any one territory in each component, which
+    // this labels on the way
+    uint32_t maxDegree = 0;
+    for (int t = 0; t < n; ++t) maxDegree = std::max(maxDegree, m.adjStart[t+1] - m.adjStart[t]);
+    std::vector<int32_t> level(n, -1);
+    std::vector<uint32_t> queue(n), labels(n);
+    uint64_t bound = maxDegree;
+    for (int s = 0, c = 0; s < n; ++s) {
+        if (level[s] >= 0) continue;
+        size_t reached;
+        bound = std::max(bound, (uint64_t)2 * bfs(m, s, level, queue, &reached));
+        for (size_t k = 0; k < reached; ++k) labels[queue[k]] = (uint32_t)c;
+        ++c;
+    }
+    width = bound < 0xFF ? 1 : bound < 0xFFFF ? 2 : 0;
+
+    if (width && (uint64_t)n * n * width * 2 <= maxBytes) {
+        numLandmarks = 0;
+        owned.resize((size_t)n * n * width * 2);
+        bindData(owned.data());
+        if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+        threads = std::max(1, std::min(threads, n / 256)); // small maps stay inline
+        std::atomic<int> nextSource(0);
+        auto worker = [&]() {
+            if (width == 1) fillRows(m, owned.data(), owned.data() + (size_t)n * n, nextSource);
+            else fillRows(m, (uint16_t*)owned.data(), (uint16_t*)owned.data() + (size_t)n * n, nextSource);
+        };
+        std::vector<std::thread> pool;
+        for (int i = 1; i < threads; ++i) pool.emplace_back(worker);
+        worker();
+        for (std::thread &t : pool) t.join();
+        return;
+    }
+
+    // Landmarks, each the territory farthest from those already picked;
+    // territories no landmark reaches count as farthest, so every component
+    // gets one while they last.
+    width = 2;
+    numLandmarks = std::min(n, (int)kMaxLandmarks);
+    owned.resize((size_t)n * (sizeof(uint32_t) + numLandmarks * sizeof(uint16_t)));
+    bindData(owned.data());
+    std::memcpy(owned.data(), labels.data(), (size_t)n * sizeof(uint32_t));
+    uint16_t* out = (uint16_t*)(owned.data() + (size_t)n * sizeof(uint32_t));
+    std::vector<int32_t> nearest(n, INT_MAX);
+    for (int l = 0; l < numLandmarks; ++l) {
+        int pick = (int)(std::max_element(nearest.begin(), nearest.end()) - nearest.begin());
+        std::fill(level.begin(), level.end(), -1);
+        bfs(m, pick, level, queue);
+        for (int t = 0; t < n; ++t) {
+            out[(size_t)t * numLandmarks + l] = level[t] < 0 ? 0xFFFF : (uint16_t)std::min(level[t], 0xFFFE);
+            if (level[t] >= 0) nearest[t] = std::min(nearest[t], level[t]);
+        }
+    }
+}
+
+void DistanceTable::load(const MapData &m, const char* mapPath, int threads, size_t maxBytes) {
+    release();
+    map = &m;
+    n = (int)m.numTerrs;
+
+    long long srcSize = -1, srcMtime = -1;
+    if (statFile(mapPath, srcSize, srcMtime)) {
+        std::string cachePath = distCachePath(mapPath);
+        if (mapCache(cachePath, srcSize, srcMtime)) {
+            fromCache = true;
+            return;
+        }
+    }
+    build(m, threads, maxBytes);
+}
+
+bool DistanceTable::saveCache(const char* mapPath, std::string &err) const {
+    std::string cachePath = distCachePath(mapPath);
+    long long srcSize, srcMtime;
+    if (!statFile(mapPath, srcSize, srcMtime) || !writeCache(cachePath, srcSize, srcMtime)) {
+        err = cachePath + ": cannot write";
+        return false;
+    }
+    return true;
+}
+
+bool DistanceTable::mapCache(const std::string &path, long long srcSize, long long srcMtime) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < kDataOffset) {
+        close(fd);
+        return false;
+    }
+    size_t len = (size_t)st.st_size;
+    void* base = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return false;
+
+    CacheHeader hdr;
+    std::memcpy(&hdr, base, sizeof(hdr));
+    bool ok = std::memcmp(hdr.magic, kMagic, sizeof(kMagic)) == 0 &&
+              hdr.version == kVersion &&
+              hdr.numTerrs == map->numTerrs &&
+              hdr.srcSize == srcSize && hdr.srcMtime == srcMtime &&
+              (hdr.width == 1 || hdr.width == 2) &&
+              hdr.numLandmarks <= (uint32_t)kMaxLandmarks;
+    if (ok) {
+        width = (int)hdr.width;
+        numLandmarks = (int)hdr.numLandmarks;
+        uint64_t need = numLandmarks == 0 ? (uint64_t)n * n * width * 2
+                                          : (uint64_t)n * (sizeof(uint32_t) + numLandmarks * sizeof(uint16_t));
+        ok = need <= len - kDataOffset && hdr.graphHash == graphHash(*map);
+    }
+    if (!ok) {
+        munmap(base, len);
+        return false;
+    }
+    mapped = base;
+    mappedLen = len;
+    bindData((const uint8_t*)base + kDataOffset);
+    return true;
+}
+
+bool DistanceTable::writeCache(const std::string &path, long long srcSize, long long srcMtime) const {
+    CacheHeader hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    std::memcpy(hdr.magic, kMagic, sizeof(kMagic));
+    hdr.version      = kVersion;
+    hdr.numTerrs     = (uint32_t)n;
+    hdr.width        = (uint32_t)width;
+    hdr.numLandmarks = (uint32_t)numLandmarks;
+    hdr.graphHash    = graphHash(*map);
+    hdr.srcSize      = srcSize;
+    hdr.srcMtime     = srcMtime;
+    char pad[kDataOffset] = {};
+    std::memcpy(pad, &hdr, sizeof(hdr));
+
+    // write beside the target and rename, so a crash never leaves half a cache
+    std::string tmp = path + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = std::fwrite(pad, 1, sizeof(pad), f) == sizeof(pad) &&
+              std::fwrite(owned.data(), 1, dataLen, f) == dataLen;
+    ok = (std::fclose(f) == 0) && ok;
+    if (ok) ok = std::rename(tmp.c_str(), path.c_str()) == 0;
+    if (!ok) std::remove(tmp.c_str());
+    return ok;
+}
+
+int DistanceTable::distance(int a, int b) const {
+    if (a == b) return 0;
+    if (numLandmarks == 0) {
+        unsigned d = entry(dist, (size_t)a * n + b);
+        return d == (width == 1 ? 0xFFu : 0xFFFFu) ? -1 : (int)d;
+    }
+    if (component[a] != component[b]) return -1;
+    // triangle inequality: |d(l,a) - d(l,b)| <= d(a,b) for every landmark l;
+    // a landmark in another component reaches neither
+    const uint16_t* ra = lmDist + (size_t)a * numLandmarks;
+    const uint16_t* rb = lmDist + (size_t)b * numLandmarks;
+    int best = 1;
+    for (int l = 0; l < numLandmarks; ++l) {
+        if (ra[l] == 0xFFFF) continue;
+        best = std::max(best, std::abs((int)ra[l] - (int)rb[l]));
+    }
+    return best;
+}
+
+int DistanceTable::nextHop(int a, int b) const {
+    if (a == b) return -1;
+    if (numLandmarks == 0) {
+        unsigned slot = entry(hop, (size_t)a * n + b);
+        return slot == (width == 1 ? 0xFFu : 0xFFFFu) ? -1 : (int)map->adjList[map->adjStart[a] + slot];
+    }
+    // A* guided by the landmark bound, which is consistent, so b is first
+    // popped along a shortest path; each node carries its first hop from a
+    if (distance(a, b) < 0) return -1;
+    typedef std::pair<int,int> Entry; // (estimate, territory)
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+    std::unordered_map<int, std::pair<int,int>> seen; // territory -> (hops, first hop)
+    seen[a] = std::make_pair(0, -1);
+    open.push(Entry(distance(a, b), a));
+    while (!open.empty()) {
+        int u = open.top().second;
+        int f = open.top().first;
+        open.pop();
+        std::pair<int,int> su = seen[u];
+        if (f != su.first + distance(u, b)) continue; // stale entry
+        if (u == b) return su.second;
+        for (uint32_t k = map->adjStart[u]; k < map->adjStart[u+1]; ++k) {
+            int v = (int)map->adjList[k];
+            auto it = seen.find(v);
+            if (it != seen.end() && it->second.first <= su.first + 1) continue;
+            seen[v] = std::make_pair(su.first + 1, u == a ? v : su.second);
+            open.push(Entry(su.first + 1 + distance(v, b), v));
+        }
+    }
+    return -1;
+}
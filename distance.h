@@ -0,0 +1,77 @@
+// distance.h
+#ifndef DISTANCE_H
+#define DISTANCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "map.h"
+
+// Hop distances between territories over the adjacency graph.
+// When the full matrix fits in maxBytes, every pair is stored along with
+// a next-hop table, built by one BFS per source spread over threads; the
+// entries are uint8 when the graph allows it and uint16 otherwise. Larger
+// maps keep BFS distances from a few landmarks and answer with estimates,
+// plus a component label per territory, so unreachable stays exact.
+// The map must outlive the table.
+class DistanceTable {
+public:
+    static const size_t kDefaultMaxBytes = (size_t)64 << 20;
+    static const int    kMaxLandmarks    = 16;
+
+    DistanceTable() = default;
+    ~DistanceTable();
+    DistanceTable(const DistanceTable&) = delete;
+    DistanceTable& operator=(const DistanceTable&) = delete;
+
+    // threads <= 0 uses every core
+    void build(const MapData &m, int threads = 0, size_t maxBytes = kDefaultMaxBytes);
+
+    // maps "<mapPath>.dist" when it was built from this file and graph,
+    // otherwise builds the table
+    void load(const MapData &m, const char* mapPath, int threads = 0,
+              size_t maxBytes = kDefaultMaxBytes);
+    // writes "<mapPath>.dist" for load to find; risk_mapc does this
+    bool saveCache(const char* mapPath, std::string &err) const;
+
+    bool exact() const { return numLandmarks == 0; }
+
+    // hops from a to b, -1 if unreachable; a lower bound unless exact()
+    int distance(int a, int b) const;
+
+    // neighbor of a one step closer to b, -1 if a == b or unreachable.
+    // Without the full matrix this runs an A* search on the estimates.
+    int nextHop(int a, int b) const;
+
+    size_t bytes() const { return dataLen; }
+    bool fromCache = false;
+
+private:
+    const MapData* map = nullptr;
+    int n = 0;
+    int width = 1;         // bytes per matrix entry
+    int numLandmarks = 0;  // 0: full matrix
+    const uint8_t*  dist = nullptr;   // n*n, row = source
+    const uint8_t*  hop  = nullptr;   // n*n, slot in the source's adjacency row
+    const uint32_t* component = nullptr; // n, with landmarks
+    const uint16_t* lmDist = nullptr; // n*numLandmarks, row = territory
+    size_t dataLen = 0;
+
+    std::vector<uint8_t> owned;
+    void*  mapped = nullptr;
+    size_t mappedLen = 0;
+
+    void release();
+    void bindData(const uint8_t* data);
+    bool mapCache(const std::string &path, long long srcSize, long long srcMtime);
+    bool writeCache(const std::string &path, long long srcSize, long long srcMtime) const;
+
+    unsigned entry(const uint8_t* p, size_t i) const {
+        return width == 1 ? p[i] : ((const uint16_t*)p)[i];
+    }
+};
+
+std::string distCachePath(const char* mapPath);
+
+#endif
@@ -1,12 +1,21 @@
 // game.cpp
 #include "game.h"
 #include <algorithm>
-#include <cstdlib>
 #include <ctime>
 
 Game::Game() {
-    std::srand((unsigned int)std::time(nullptr));
-    initSimpleMap();
+    seedRng((uint64_t)std::time(nullptr));
+    setMap(builtinMap());
+}
+
+void Game::newGame() {
+    // alternate P1/P2 over the map, 3 armies each
+    for (int i = 0; i < (int)terrs.size(); ++i) {
+        terrs[i].armies = 3;
+        terrs[i].owner  = (i % 2 == 0) ? 0 : 1;
+        terrs[i].capturing = terrs[i].reinforcing = false;
+    }
+    regions.build(*map, terrs);
     currentPlayer = 0;
     phase = PHASE_REINFORCE;
     reinforcementsLeft = 3;
@@ -15,14 +24,40 @@ Game::Game() {
     attackSel = {};
     fortSel = {};
     fortifyDone = false;
+    history.reset(*this);
+}
+
+void Game::setMap(std::shared_ptr<const MapData> m) {
+    useMap(std::move(m), nullptr);
+}
+
+bool Game::loadMap(const char* path, std::string &err) {
+    std::shared_ptr<const MapData> loaded = MapData::load(path, err);
+    if (!loaded) return false;
+    useMap(loaded, path);
+    return true;
+}
+
+void Game::useMap(std::shared_ptr<const MapData> m, const char* path) {
+    map = std::move(m);
+    std::shared_ptr<DistanceTable> d = std::make_shared<DistanceTable>();
+    if (path) d->load(*map, path);
+    else d->build(*map);
+    dist = d;
+    terrs.assign(map->numTerrs, Territory());
+    newGame();
 }
 
-void Game::initSimpleMap() {
-    terrs.clear();
+namespace {
+
+MapSource simpleWorldSource() {
+    MapSource src;
+    src.name = "builtin";
+    std::vector<TerritorySource> &terrs = src.terrs;
     terrs.resize(14);
 
     // helper: add a vertex from lon/lat (in degrees)
-    auto addVertexDeg = [](Territory &t, float lonDeg, float latDeg) {
+    auto addVertexDeg = [](TerritorySource &t, float lonDeg, float latDeg) {
         float x = lonDeg / 180.0f; // [-180,180] -> [-1,1]
         float y = latDeg / 90.0f;  // [-90,90]   -> [-1,1]
         t.polyX.push_back(x);
@@ -30,21 +65,19 @@ void Game::initSimpleMap() {
     };
 
     // helper: set label from lon/lat
-    auto setLabelDeg = [](Territory &t, float lonDeg, float latDeg) {
+    auto setLabelDeg = [](TerritorySource &t, float lonDeg, float latDeg) {
         t.labelX = lonDeg / 180.0f;
         t.labelY = latDeg / 90.0f;
     };
 
-    auto setColor = [](Territory &t, float r, float g, float b) {
+    auto setColor = [](TerritorySource &t, float r, float g, float b) {
         t.r = r; t.g = g; t.b = b;
-        t.capturing = false;
-        t.animT = 0.0f;
     };
 
     // ================= NORTH AMERICA (0–3) =================
     // 0: NA North-West (Alaska / western Canada)
     {
-        Territory &t = terrs[0];
+        TerritorySource &t = terrs[0];
         addVertexDeg(t, -170.0f, 72.0f);
         addVertexDeg(t, -130.0f, 72.0f);
         addVertexDeg(t, -125.0f, 60.0f);
@@ -57,7 +90,7 @@ void Game::initSimpleMap() {
 
     // 1: NA North-East (eastern Canada / Greenland south)
     {
-        Territory &t = terrs[1];
+        TerritorySource &t = terrs[1];
         addVertexDeg(t, -130.0f, 72.0f);
         addVertexDeg(t,  -70.0f, 72.0f);
         addVertexDeg(t,  -60.0f, 55.0f);
@@ -70,7 +103,7 @@ void Game::initSimpleMap() {
 
     // 2: NA South-West (US west / Mexico west)
     {
-        Territory &t = terrs[2];
+        TerritorySource &t = terrs[2];
         addVertexDeg(t, -130.0f, 50.0f);
         addVertexDeg(t, -100.0f, 50.0f);
         addVertexDeg(t, -100.0f, 35.0f);
@@ -83,7 +116,7 @@ void Game::initSimpleMap() {
 
     // 3: NA South-East (US east / Mexico east / Caribbean)
     {
-        Territory &t = terrs[3];
+        TerritorySource &t = terrs[3];
         addVertexDeg(t, -100.0f, 50.0f);
         addVertexDeg(t,  -65.0f, 50.0f);
         addVertexDeg(t,  -80.0f, 30.0f);
@@ -97,7 +130,7 @@ void Game::initSimpleMap() {
     // ================= SOUTH AMERICA (4–6) =================
     // 4: SA North
     {
-        Territory &t = terrs[4];
+        TerritorySource &t = terrs[4];
         addVertexDeg(t, -90.0f,  15.0f);
         addVertexDeg(t, -50.0f,  7.0f);
         addVertexDeg(t, -50.0f,   0.0f);
@@ -109,7 +142,7 @@ void Game::initSimpleMap() {
 
     // 5: SA West / Central
     {
-        Territory &t = terrs[5];
+        TerritorySource &t = terrs[5];
         addVertexDeg(t, -80.0f,   -5.0f);
         addVertexDeg(t, -60.0f,  -5.0f);
         addVertexDeg(t, -65.0f, -20.0f);
@@ -121,7 +154,7 @@ void Game::initSimpleMap() {
 
     // 6: SA South / East
     {
-        Territory &t = terrs[6];
+        TerritorySource &t = terrs[6];
         addVertexDeg(t, -60.0f,  -5.0f);
         addVertexDeg(t, -50.0f,   0.0f);
         addVertexDeg(t, -37.0f, -5.0f);
@@ -136,7 +169,7 @@ void Game::initSimpleMap() {
     // ================= EUROPE (7–8) ======================
     // 7: Western Europe
     {
-        Territory &t = terrs[7];
+        TerritorySource &t = terrs[7];
         addVertexDeg(t, -25.0f, 72.0f);
         addVertexDeg(t,   5.0f, 72.0f);
         addVertexDeg(t,  12.0f, 45.0f);
@@ -149,7 +182,7 @@ void Game::initSimpleMap() {
 
     // 8: Eastern Europe
     {
-        Territory &t = terrs[8];
+        TerritorySource &t = terrs[8];
         addVertexDeg(t,   5.0f, 72.0f);
         addVertexDeg(t,  45.0f, 72.0f);
         addVertexDeg(t,  45.0f, 35.0f);
@@ -162,7 +195,7 @@ void Game::initSimpleMap() {
     // ================= AFRICA (9–10) =====================
     // 9: North Africa
     {
-        Territory &t = terrs[9];
+        TerritorySource &t = terrs[9];
         addVertexDeg(t, -15.0f,  35.0f);
         addVertexDeg(t,  35.0f,  35.0f);
         addVertexDeg(t,  35.0f,  10.0f);
@@ -175,7 +208,7 @@ void Game::initSimpleMap() {
 
     // 10: South Africa
     {
-        Territory &t = terrs[10];
+        TerritorySource &t = terrs[10];
         addVertexDeg(t, -20.0f,  10.0f);
         addVertexDeg(t,  35.0f,  10.0f);
         addVertexDeg(t,  35.0f, -35.0f);
@@ -188,7 +221,7 @@ void Game::initSimpleMap() {
 
     // ================= MIDDLE EAST (11) ==================
     {
-        Territory &t = terrs[11];
+        TerritorySource &t = terrs[11];
         addVertexDeg(t,  35.0f,  35.0f);
         addVertexDeg(t,  45.0f,  35.0f);
         addVertexDeg(t,  52.5f,  25.0f);
@@ -201,7 +234,7 @@ void Game::initSimpleMap() {
 
     // ================= ASIA (12) ========================
     {
-        Territory &t = terrs[12];
+        TerritorySource &t = terrs[12];
         addVertexDeg(t,  45.0f, 80.0f);
         addVertexDeg(t, 180.0f, 80.0f);
         addVertexDeg(t, 180.0f,  5.0f);
@@ -215,7 +248,7 @@ void Game::initSimpleMap() {
 
     // ================= OCEANIA (13) =====================
     {
-        Territory &t = terrs[13];
+        TerritorySource &t = terrs[13];
         addVertexDeg(t, 110.0f,  -5.0f);
         addVertexDeg(t, 180.0f,  -5.0f);
         addVertexDeg(t, 180.0f, -48.0f);
@@ -229,7 +262,7 @@ void Game::initSimpleMap() {
     // ================ ADJACENCY =========================
     // 0–3: North America
     terrs[0].neighbors = {1, 2};          // NA NW <-> NA NE, SW
-    terrs[1].neighbors = {0, 3, 7};       // NA NE <-> NW, SE, W Europe (via Greenland/Iceland)
+    terrs[1].neighbors = {0, 3, 7, 12};   // NA NE <-> NW, SE, W Europe (via Greenland/Iceland), Asia
     terrs[2].neighbors = {0, 3, 4};       // NA SW <-> NW, SE, SA North
     terrs[3].neighbors = {1, 2, 4};       // NA SE <-> NE, SW, SA North
 
@@ -255,11 +288,14 @@ void Game::initSimpleMap() {
     // 13: Oceania
     terrs[13].neighbors = {12};                 // Oceania <-> Asia
 
-    // ============== INITIAL OWNERSHIP ==================
-    for (int i = 0; i < (int)terrs.size(); ++i) {
-        terrs[i].armies = 3;
-        terrs[i].owner  = (i % 2 == 0) ? 0 : 1;  // alternate P1/P2
-    }
+    return src;
+}
+
+} // namespace
+
+std::shared_ptr<const MapData> Game::builtinMap() {
+    static std::shared_ptr<const MapData> m = MapData::compile(simpleWorldSource());
+    return m;
 }
 
 
@@ -269,12 +305,35 @@ bool Game::isOwner(int terrIdx, int player) const {
 }
 
 bool Game::isAdjacent(int a, int b) const {
-    for (int n : terrs[a].neighbors) if (n==b) return true;
-    return false;
+    return map->isAdjacent(a, b);
 }
 
-int Game::rollDie() const {
-    return (std::rand() % 6) + 1; // 1-6
+void Game::frontier(int player, std::vector<int> &out) const {
+    out.clear();
+    // one pass over the CSR rows, in memory order
+    const uint32_t* adj = map->adjList.ptr;
+    for (int t = 0; t < (int)terrs.size(); ++t) {
+        if (terrs[t].owner != player) continue;
+        for (uint32_t k = map->adjStart[t]; k < map->adjStart[t+1]; ++k) {
+            if (terrs[adj[k]].owner != player) {
+                out.push_back(t);
+                break;
+            }
+        }
+    }
+}
+
+void Game::seedRng(uint64_t seed) {
+    rngSeed = seed;
+    rngCount = 0;
+}
+
+int Game::rollDie() {
+    uint64_t z = rngSeed + (++rngCount) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return (int)(((z >> 32) * 6) >> 32) + 1; // 1-6
 }
 
 void Game::nextPhase() {
@@ -396,6 +455,7 @@ void Game::resolveAttack() {
         terrs[D].owner = terrs[A].owner;
         terrs[D].armies = 1;
         terrs[A].armies -= 1; // move in 1 army
+        regions.changeOwner(*map, terrs, D, oldOwner);
 
         // start capture animation
         terrs[D].capturing = true;
@@ -408,6 +468,12 @@ void Game::resolveAttack() {
 }
 
 // -------- Fortify ----------
+bool Game::canFortify(int from, int to, int armies) const {
+    if (from == to || !isOwner(from, currentPlayer)) return false;
+    if (armies < 1 || armies >= terrs[from].armies) return false;
+    // same label means same owner and a chain of that owner's land
+    return regions.connected(from, to);
+}
 bool Game::selectFortifyFrom(int terrIdx) {
     if (fortifyDone) return false;
     if (!isOwner(terrIdx, currentPlayer)) return false;
@@ -416,25 +482,100 @@ bool Game::selectFortifyFrom(int terrIdx) {
     fortSel.toTerr = -1;
     return true;
 }
-bool Game::selectFortifyTo(int terrIdx) {
+bool Game::selectFortifyTo(int terrIdx, int armies) {
     if (fortifyDone) return false;
     if (fortSel.fromTerr < 0) return false;
-    if (!isOwner(terrIdx, currentPlayer)) return false;
-    if (!isAdjacent(fortSel.fromTerr, terrIdx)) return false;
+    if (!canFortify(fortSel.fromTerr, terrIdx, armies)) return false;
     fortSel.toTerr = terrIdx;
-    doFortifyMove();
+    doFortifyMove(armies);
     return true;
 }
-void Game::doFortifyMove() {
+void Game::doFortifyMove(int armies) {
     int A = fortSel.fromTerr;
     int B = fortSel.toTerr;
     if (A<0 || B<0) return;
-    // move exactly 1 army
-    terrs[A].armies -= 1;
-    terrs[B].armies += 1;
+    terrs[A].armies -= armies;
+    terrs[B].armies += armies;
     fortifyDone = true;
 }
 
+// -------- Commands ----------
+Command Game::commandForClick(int terrIdx) const {
+    Command cmd;
+    cmd.terr = terrIdx;
+    switch(phase){
+        case PHASE_REINFORCE:
+            cmd.type = CMD_PLACE;
+            break;
+        case PHASE_ATTACK:
+            // if we haven't picked from
+            cmd.type = attackSel.fromTerr < 0 ? CMD_ATTACK_FROM : CMD_ATTACK_TO;
+            break;
+        case PHASE_FORTIFY:
+            cmd.type = fortSel.fromTerr < 0 ? CMD_FORTIFY_FROM : CMD_FORTIFY_TO;
+            break;
+    }
+    return cmd;
+}
+
+Command Game::resolve(const Command &cmd) const {
+    if (cmd.type != CMD_CLICK) return cmd;
+    Command resolved = commandForClick(cmd.terr);
+    resolved.armies = cmd.armies;
+    return resolved;
+}
+
+bool Game::apply(const Command &cmd) {
+    touched.clear();
+    if (gameOver) return false;
+    switch (cmd.type) {
+        case CMD_CLICK: return apply(resolve(cmd));
+        case CMD_UNDO:  return history.undo(*this);
+        case CMD_REDO:  return history.redo(*this);
+        default: break;
+    }
+
+    // the territories an action can change: its own and the selected source
+    int player = currentPlayer;
+    int changed[2] = {cmd.terr, cmd.type == CMD_ATTACK_TO ? attackSel.fromTerr : fortSel.fromTerr};
+    int count = cmd.type == CMD_PLACE ? 1 :
+                cmd.type == CMD_ATTACK_TO || cmd.type == CMD_FORTIFY_TO ? 2 : 0;
+    if (!perform(cmd)) return false;
+    for (int k = 0; k < count; ++k) if (changed[k] >= 0) touched.push_back(changed[k]);
+
+    // dice and turn ends can't be taken back
+    bool undoable = cmd.type != CMD_ATTACK_TO && currentPlayer == player && !gameOver;
+    history.commit(*this, changed, count, undoable);
+    return true;
+}
+
+bool Game::perform(const Command &cmd) {
+    if (cmd.type == CMD_NEXT_PHASE) {
+        Phase before = phase;
+        nextPhase();
+        return phase != before;
+    }
+
+    // everything else names a territory
+    if (cmd.terr < 0 || cmd.terr >= (int)terrs.size()) return false;
+    switch(cmd.type){
+        case CMD_PLACE:
+            if (phase != PHASE_REINFORCE || !canPlaceReinforcement(cmd.terr)) return false;
+            placeReinforcement(cmd.terr);
+            return true;
+        case CMD_ATTACK_FROM:
+            return phase == PHASE_ATTACK && selectAttackFrom(cmd.terr);
+        case CMD_ATTACK_TO:
+            return phase == PHASE_ATTACK && selectAttackTo(cmd.terr);
+        case CMD_FORTIFY_FROM:
+            return phase == PHASE_FORTIFY && selectFortifyFrom(cmd.terr);
+        case CMD_FORTIFY_TO:
+            return phase == PHASE_FORTIFY && selectFortifyTo(cmd.terr, cmd.armies);
+        default:
+            return false;
+    }
+}
+
 std::string Game::phaseName() const {
     switch(phase){
         case PHASE_REINFORCE: return "Reinforce";
@@ -2,17 +2,18 @@
 #ifndef GAME_H
 #define GAME_H
 
+#include <memory>
 #include <vector>
 #include <string>
+#include "distance.h"
+#include "history.h"
+#include "map.h"
+#include "regions.h"
 
+// per-game state of one territory; geometry and adjacency live in MapData
 struct Territory {
-    int owner;         // -1 none, 0 player1, 1 player2
-    int armies;
-    float r, g, b;     // base color tint for rendering
-    std::vector<float> polyX;
-    std::vector<float> polyY;
-    std::vector<int> neighbors; // indices of adjacent territories
-    float labelX, labelY;       // where to draw army text
+    int owner = -1;    // -1 none, 0 player1, 1 player2
+    int armies = 0;
 
      // NEW: simple capture animation
     bool  capturing = false;
@@ -38,12 +39,35 @@ struct FortifySelection {
     int toTerr   = -1;
 };
 
+// one player action, as input, the game thread and the rules exchange it
+enum CommandType {
+    CMD_CLICK = 0,      // raw territory click, see Game::commandForClick
+    CMD_PLACE,
+    CMD_ATTACK_FROM,
+    CMD_ATTACK_TO,      // selects the target and rolls
+    CMD_FORTIFY_FROM,
+    CMD_FORTIFY_TO,     // selects the target and moves
+    CMD_NEXT_PHASE,
+    CMD_UNDO,           // see UndoHistory
+    CMD_REDO
+};
+
+struct Command {
+    CommandType type = CMD_NEXT_PHASE;
+    int terr = -1;
+    int armies = 1;     // CMD_FORTIFY_TO: how many to move
+};
+
 class Game {
 public:
     Game();
 
     // core state
-    std::vector<Territory> terrs;
+    std::shared_ptr<const MapData> map; // shared, never modified
+    std::vector<Territory> terrs;       // one per map territory
+    OwnerRegions regions;               // same-owner groups over terrs
+    UndoHistory history;                // undoable steps since the last roll
+    std::vector<int> touched;           // territories the last apply() changed
     int currentPlayer;  // 0 or 1
     Phase phase;
     int reinforcementsLeft;
@@ -54,8 +78,19 @@ public:
     FortifySelection fortSel;
     bool fortifyDone;
 
+    // dice: SplitMix64 at seed + draw number, so the stream can be saved
+    // and picked up again at any draw
+    uint64_t rngSeed = 0;
+    uint64_t rngCount = 0;
+
     // --- logic functions ---
-    void initSimpleMap();
+    static std::shared_ptr<const MapData> builtinMap(); // 14-territory fallback
+    void setMap(std::shared_ptr<const MapData> m); // and start a new game
+    bool loadMap(const char* path, std::string &err);
+    // hop distances over map, built with it: mapped from the cache
+    // risk_mapc writes beside a map file when that is current
+    const DistanceTable &distances() const { return *dist; }
+    void newGame(); // initial owners and armies, turn state reset
     void nextPhase();
     void endTurnIfNeeded();
     void checkWin();
@@ -69,17 +104,32 @@ public:
     bool selectAttackTo(int terrIdx);
     void resolveAttack(); // rolls dice + applies result
 
-    // fortify
+    // fortify: any number of armies, along any chain of the player's land
+    bool canFortify(int from, int to, int armies) const;
     bool selectFortifyFrom(int terrIdx);
-    bool selectFortifyTo(int terrIdx);
-    void doFortifyMove();
+    bool selectFortifyTo(int terrIdx, int armies = 1);
+    void doFortifyMove(int armies);
+
+    // commands
+    Command commandForClick(int terrIdx) const; // what a click means right now
+    Command resolve(const Command &cmd) const;  // clicks become what they mean
+    bool apply(const Command &cmd);             // false if the rules reject it
 
     // helpers
     bool isAdjacent(int a, int b) const;
+    // player's territories with an enemy or neutral neighbor, in index order
+    void frontier(int player, std::vector<int> &out) const;
     bool isOwner(int terrIdx, int player) const;
-    int  rollDie() const; // 1-6
+    void seedRng(uint64_t seed); // restarts the dice stream
+    int  rollDie(); // 1-6
 
     std::string phaseName() const;
+
+private:
+    std::shared_ptr<const DistanceTable> dist; // shared by copies, like map
+
+    void useMap(std::shared_ptr<const MapData> m, const char* path);
+    bool perform(const Command &cmd); // apply() for rule commands
 };
 
 #endif
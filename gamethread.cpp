@@ -0,0 +1,186 @@
+// gamethread.cpp
+#include "gamethread.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+GameThread::~GameThread() {
+    stop();
+}
+
+void GameThread::start(const Game &initial) {
+    join();
+    game = initial;
+    size_t n = game.terrs.size();
+    captureSeq.assign(n, 0);
+    reinforceSeq.assign(n, 0);
+    seenCapture.assign(n, 0);
+    seenReinforce.assign(n, 0);
+    listed.assign(n, 0);
+    changeLog.clear();
+    pending.clear();
+    logFloor = version + 1; // every buffer is written whole once
+
+    publish(); // the view starts in sync
+    running = true;
+    worker = std::thread(&GameThread::run, this);
+}
+
+bool GameThread::record(const char* path, const Game &initial, bool syncTurns, std::string &err) {
+    return journal.open(path, initial, syncTurns, err);
+}
+
+void GameThread::join() {
+    if (!worker.joinable()) return;
+    running = false;
+    wake.notify_one();
+    worker.join();
+}
+
+void GameThread::stop() {
+    join();
+    if (!journal.close()) {
+        std::fprintf(stderr, "WARNING: %s, last turn not recorded\n", journal.error().c_str());
+    }
+}
+
+bool GameThread::post(const Command &cmd) {
+    if (!inbox.push(cmd)) return false;
+    wake.notify_one();
+    return true;
+}
+
+void GameThread::run() {
+    while (running) {
+        Command cmd;
+        bool changed = false;
+        while (inbox.pop(cmd)) {
+            // the journal gets what the click meant, so replay needs no UI
+            Command resolved = game.resolve(cmd);
+            if (!game.apply(resolved)) continue;
+            if (journal.isOpen() && !journal.append(resolved, game)) {
+                std::fprintf(stderr, "WARNING: %s, no longer recording\n", journal.error().c_str());
+            }
+            pending.insert(pending.end(), game.touched.begin(), game.touched.end());
+            changed = true;
+        }
+        if (changed) {
+            publish();
+            continue;
+        }
+
+        // the timeout covers a notify that lands between pop and wait
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wake.wait_for(lock, std::chrono::milliseconds(5),
+                      [this] { return !running || !inbox.empty(); });
+    }
+}
+
+void GameThread::publish() {
+    size_t n = game.terrs.size();
+    ++version;
+    for (int i : pending) {
+        Territory &t = game.terrs[i];
+        // the rules raise animation flags; here they become events
+        if (t.capturing)   { captureSeq[i]++;   t.capturing = false; }
+        if (t.reinforcing) { reinforceSeq[i]++; t.reinforcing = false; }
+        changeLog.push_back({version, i});
+    }
+    pending.clear();
+    if (changeLog.size() > n) {
+        changeLog.clear();
+        logFloor = version + 1;
+    }
+
+    GameSnapshot &snap = snapshots.writeBuffer();
+    int slot = 0;
+    while (slot < 2 && buffers[slot] && buffers[slot] != &snap) ++slot;
+    buffers[slot] = &snap;
+    uint64_t oldest = snap.version;
+    for (int k = 0; k < 3; ++k) oldest = std::min(oldest, buffers[k] ? bufferVersion[k] : 0);
+    auto copy = [&](int i) {
+        const Territory &t = game.terrs[i];
+        snap.terrs[i] = {t.owner, t.armies, captureSeq[i], reinforceSeq[i]};
+    };
+
+    // bring this buffer up to date
+    if (snap.version < logFloor || snap.terrs.size() != n) {
+        snap.terrs.resize(n);
+        for (size_t i = 0; i < n; ++i) copy((int)i);
+    } else {
+        for (const auto &c : changeLog) if (c.first > snap.version) copy(c.second);
+    }
+
+    // and say what the reader may not have seen
+    snap.full = oldest < logFloor;
+    snap.changed.clear();
+    if (!snap.full) {
+        for (const auto &c : changeLog) {
+            if (c.first <= oldest || listed[c.second] == version) continue;
+            listed[c.second] = version;
+            snap.changed.push_back(c.second);
+        }
+    }
+    snap.version = bufferVersion[slot] = version;
+
+    // what every buffer has seen is no longer needed
+    oldest = version;
+    for (int k = 0; k < 3; ++k) oldest = std::min(oldest, buffers[k] ? bufferVersion[k] : 0);
+    size_t keep = 0;
+    while (keep < changeLog.size() && changeLog[keep].first <= oldest) ++keep;
+    changeLog.erase(changeLog.begin(), changeLog.begin() + keep);
+
+    snap.currentPlayer      = game.currentPlayer;
+    snap.phase              = game.phase;
+    snap.reinforcementsLeft = game.reinforcementsLeft;
+    snap.gameOver           = game.gameOver;
+    snap.winner             = game.winner;
+    snap.attackSel          = game.attackSel;
+    snap.fortSel            = game.fortSel;
+    snap.fortifyDone        = game.fortifyDone;
+    snapshots.publish();
+}
+
+bool GameThread::poll(Game &view) {
+    if (!snapshots.update()) return false;
+    const GameSnapshot &snap = snapshots.readBuffer();
+    size_t n = std::min(snap.terrs.size(), view.terrs.size());
+    bool ownersChanged = false;
+    auto take = [&](int i) {
+        Territory &t = view.terrs[i];
+        const TerrState &s = snap.terrs[i];
+        int oldOwner = t.owner;
+        t.owner  = s.owner;
+        t.armies = s.armies;
+        if (s.captureSeq != seenCapture[i]) {
+            seenCapture[i] = s.captureSeq;
+            t.capturing = true;
+            t.animT = 0.0f;
+        }
+        if (s.reinforceSeq != seenReinforce[i]) {
+            seenReinforce[i] = s.reinforceSeq;
+            t.reinforcing = true;
+            t.reinfT = 0.0f;
+        }
+        // the view only sees owners; its regions follow them one capture
+        // at a time, or are rebuilt after a whole copy
+        if (t.owner == oldOwner) return;
+        if (snap.full) ownersChanged = true;
+        else view.regions.changeOwner(*view.map, view.terrs, i, oldOwner);
+    };
+    if (snap.full) {
+        for (size_t i = 0; i < n; ++i) take((int)i);
+    } else {
+        for (int i : snap.changed) if ((size_t)i < n) take(i);
+    }
+    view.currentPlayer      = snap.currentPlayer;
+    view.phase              = snap.phase;
+    view.reinforcementsLeft = snap.reinforcementsLeft;
+    view.gameOver           = snap.gameOver;
+    view.winner             = snap.winner;
+    view.attackSel          = snap.attackSel;
+    view.fortSel            = snap.fortSel;
+    view.fortifyDone        = snap.fortifyDone;
+    if (ownersChanged) view.regions.build(*view.map, view.terrs);
+    return true;
+}
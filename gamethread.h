@@ -0,0 +1,96 @@
+// gamethread.h
+#ifndef GAMETHREAD_H
+#define GAMETHREAD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "game.h"
+#include "journal.h"
+#include "spsc.h"
+
+// per-territory state the renderer needs from a snapshot
+struct TerrState {
+    int owner;
+    int armies;
+    uint32_t captureSeq;   // bumped on every capture, starts the flash
+    uint32_t reinforceSeq; // bumped on every placed reinforcement
+};
+
+struct GameSnapshot {
+    std::vector<TerrState> terrs;
+    // territories that may differ from any older snapshot the reader can
+    // still hold; every territory when full
+    std::vector<int> changed;
+    bool full = true;
+    uint64_t version = 0;  // publish count; 0 never written
+    int currentPlayer = 0;
+    Phase phase = PHASE_REINFORCE;
+    int reinforcementsLeft = 0;
+    bool gameOver = false;
+    int winner = -1;
+    AttackSelection attackSel;
+    FortifySelection fortSel;
+    bool fortifyDone = false;
+};
+
+// Owns the authoritative Game on its own thread. Input callbacks post
+// commands without blocking; the renderer polls the latest snapshot.
+class GameThread {
+public:
+    ~GameThread();
+
+    // journal every accepted command to path, from initial on; call
+    // before start(initial)
+    bool record(const char* path, const Game &initial, bool syncTurns, std::string &err);
+
+    void start(const Game &initial);
+    void stop(); // also closes the journal
+
+    // called from the input thread; false if the queue is full
+    bool post(const Command &cmd);
+
+    // the authoritative game; only safe to read while stopped
+    const Game &state() const { return game; }
+
+    // called from the render thread: copy the newest state into view,
+    // starting capture / reinforce animations; false if nothing changed
+    bool poll(Game &view);
+
+private:
+    Game game;
+    std::thread worker;
+    std::atomic<bool> running{false};
+
+    SpscQueue<Command, 256> inbox;
+    JournalWriter journal;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+
+    TripleBuffer<GameSnapshot> snapshots;
+    std::vector<uint32_t> captureSeq, reinforceSeq;         // game thread
+    std::vector<uint32_t> seenCapture, seenReinforce;       // render thread
+
+    // Game thread: a snapshot buffer is only brought up to date with what
+    // changed since it was last written, and lists what changed since the
+    // oldest of the three, which no reader can be behind. The log holds
+    // those changes; past a map's worth, it is dropped and buffers older
+    // than logFloor are copied whole.
+    uint64_t version = 0;
+    uint64_t logFloor = 0;
+    std::vector<std::pair<uint64_t, int>> changeLog;        // version, territory
+    std::vector<int> pending;                               // since the last publish
+    std::vector<uint64_t> listed;                           // dedupes changed lists
+    const GameSnapshot* buffers[3] = {};
+    uint64_t bufferVersion[3] = {};
+
+    void join();
+    void run();
+    void publish();
+};
+
+#endif
@@ -0,0 +1,125 @@
+// history.cpp
+#include "history.h"
+#include "game.h"
+#include <algorithm>
+
+UndoHistory::NodePtr UndoHistory::build(const Game &g, int level, size_t base) const {
+    size_t n = g.terrs.size();
+    if (level == 0) {
+        std::shared_ptr<Leaf> leaf = std::make_shared<Leaf>();
+        for (int i = 0; i < kFanout; ++i) {
+            bool real = base + i < n;
+            leaf->owner[i]  = real ? g.terrs[base + i].owner : -1;
+            leaf->armies[i] = real ? g.terrs[base + i].armies : 0;
+        }
+        return leaf;
+    }
+    std::shared_ptr<Inner> inner = std::make_shared<Inner>();
+    size_t span = (size_t)1 << (kBits * level); // territories per kid
+    for (int i = 0; i < kFanout && base + i * span < n; ++i) {
+        inner->kid[i] = build(g, level - 1, base + i * span);
+    }
+    return inner;
+}
+
+UndoHistory::NodePtr UndoHistory::set(const NodePtr &node, int level, size_t t,
+                                      int32_t owner, int32_t armies) const {
+    if (level == 0) {
+        std::shared_ptr<Leaf> leaf = std::make_shared<Leaf>(*static_cast<const Leaf*>(node.get()));
+        leaf->owner[t & (kFanout - 1)] = owner;
+        leaf->armies[t & (kFanout - 1)] = armies;
+        return leaf;
+    }
+    std::shared_ptr<Inner> inner = std::make_shared<Inner>(*static_cast<const Inner*>(node.get()));
+    NodePtr &kid = inner->kid[(t >> (kBits * level)) & (kFanout - 1)];
+    kid = set(kid, level - 1, t, owner, armies);
+    return inner;
+}
+
+void UndoHistory::diff(const NodePtr &from, const NodePtr &to, int level, size_t base, Game &g) const {
+    if (from == to) return; // shared, so equal all the way down
+    if (level == 0) {
+        const Leaf &b = *static_cast<const Leaf*>(to.get());
+        size_t count = std::min((size_t)kFanout, g.terrs.size() - base);
+        for (size_t i = 0; i < count; ++i) {
+            Territory &t = g.terrs[base + i];
+            if (t.owner == b.owner[i] && t.armies == b.armies[i]) continue;
+            t.owner = b.owner[i];
+            t.armies = b.armies[i];
+            g.touched.push_back((int)(base + i));
+        }
+        return;
+    }
+    const Inner &a = *static_cast<const Inner*>(from.get());
+    const Inner &b = *static_cast<const Inner*>(to.get());
+    size_t span = (size_t)1 << (kBits * level);
+    for (int i = 0; i < kFanout && b.kid[i]; ++i) {
+        diff(a.kid[i], b.kid[i], level - 1, base + i * span, g);
+    }
+}
+
+UndoHistory::Version UndoHistory::capture(const Game &g, NodePtr root) const {
+    Version v;
+    v.root               = std::move(root);
+    v.phase              = g.phase;
+    v.reinforcementsLeft = g.reinforcementsLeft;
+    v.attackFrom         = g.attackSel.fromTerr;
+    v.attackTo           = g.attackSel.toTerr;
+    v.fortFrom           = g.fortSel.fromTerr;
+    v.fortTo             = g.fortSel.toTerr;
+    v.fortifyDone        = g.fortifyDone;
+    return v;
+}
+
+void UndoHistory::reset(const Game &g) {
+    levels = 0;
+    for (size_t span = kFanout; span < g.terrs.size(); span <<= kBits) ++levels;
+    versions.assign(1, capture(g, build(g, levels, 0)));
+    cur = 0;
+}
+
+void UndoHistory::commit(const Game &g, const int* terrs, int count, bool undoable) {
+    if (versions.empty()) {
+        reset(g);
+        return;
+    }
+    NodePtr root = versions[cur].root;
+    for (int i = 0; i < count; ++i) {
+        const Territory &t = g.terrs[terrs[i]];
+        root = set(root, levels, (size_t)terrs[i], t.owner, t.armies);
+    }
+    if (!undoable) {
+        versions.assign(1, capture(g, std::move(root)));
+        cur = 0;
+        return;
+    }
+    versions.resize(cur + 1);
+    versions.push_back(capture(g, std::move(root)));
+    if (versions.size() > kMaxSteps + 1) versions.erase(versions.begin());
+    cur = versions.size() - 1;
+}
+
+void UndoHistory::restore(Game &g, size_t to) {
+    diff(versions[cur].root, versions[to].root, levels, 0, g);
+    const Version &v = versions[to];
+    g.phase              = (Phase)v.phase;
+    g.reinforcementsLeft = v.reinforcementsLeft;
+    g.attackSel.fromTerr = v.attackFrom;
+    g.attackSel.toTerr   = v.attackTo;
+    g.fortSel.fromTerr   = v.fortFrom;
+    g.fortSel.toTerr     = v.fortTo;
+    g.fortifyDone        = v.fortifyDone;
+    cur = to;
+}
+
+bool UndoHistory::undo(Game &g) {
+    if (!canUndo()) return false;
+    restore(g, cur - 1);
+    return true;
+}
+
+bool UndoHistory::redo(Game &g) {
+    if (!canRedo()) return false;
+    restore(g, cur + 1);
+    return true;
+}
@@ -0,0 +1,73 @@
+// history.h
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class Game;
+
+// Undo and redo for the actions that roll no dice: placements, fortify
+// moves, selections and phase changes within a turn. Dice rolls and turn
+// ends are a floor nothing undoes past.
+//
+// Owners and armies are kept as a persistent 32-way trie: a step copies
+// only the paths to the territories it changed and shares every other
+// node with the version before it. Undo and redo walk two versions
+// together, skip the subtrees they share, and write back only the leaves
+// that differ, so they cost the same at any map size or history depth.
+class UndoHistory {
+public:
+    static const size_t kMaxSteps = 1024; // older steps are forgotten
+
+    // g's state becomes the only version, built in full
+    void reset(const Game &g);
+
+    // g just applied an action that changed the count territories in
+    // terrs; undoable actions become a step (and drop the redo branch),
+    // others move the floor up to here
+    void commit(const Game &g, const int* terrs, int count, bool undoable);
+
+    bool canUndo() const { return cur > 0; }
+    bool canRedo() const { return cur + 1 < versions.size(); }
+    bool undo(Game &g);
+    bool redo(Game &g);
+
+private:
+    static const int kBits = 5;
+    static const int kFanout = 1 << kBits;
+
+    using NodePtr = std::shared_ptr<const void>; // Inner, or Leaf at level 0
+    struct Inner {
+        NodePtr kid[kFanout];
+    };
+    struct Leaf {
+        int32_t owner[kFanout];
+        int32_t armies[kFanout];
+    };
+
+    // turn state a step can change; player, dice and winner only change
+    // at the floor
+    struct Version {
+        NodePtr root;
+        int phase;
+        int reinforcementsLeft;
+        int attackFrom, attackTo;
+        int fortFrom, fortTo;
+        bool fortifyDone;
+    };
+
+    int levels = 0; // of Inner nodes above the leaves
+    std::vector<Version> versions;
+    size_t cur = 0;
+
+    NodePtr build(const Game &g, int level, size_t base) const;
+    NodePtr set(const NodePtr &node, int level, size_t t, int32_t owner, int32_t armies) const;
+    void diff(const NodePtr &from, const NodePtr &to, int level, size_t base, Game &g) const;
+    Version capture(const Game &g, NodePtr root) const;
+    void restore(Game &g, size_t to);
+};
+
+#endif
@@ -0,0 +1,423 @@
+// journal.cpp
+#include "journal.h"
+#include "deflate.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const char     kMagic[8] = {'R','I','S','K','J','N','L','1'};
+const uint32_t kVersion  = 1;
+const size_t   kBufferBytes = 64 * 1024;
+
+struct JournalHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t startBytes; // snapshot that follows the header
+};
+
+const char     kPackedMagic[8] = {'R','I','S','K','J','N','L','P'};
+const uint32_t kPackedVersion  = 1;
+const uint32_t kDeflated       = 1;
+const uint32_t kMaxInflate     = 1032;     // deflate's best ratio
+const uint32_t kMaxRawBytes    = 16u << 20; // hundreds of times the longest game
+
+// then the snapshot, then bodyBytes of packed (or deflated) records
+struct PackedHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t startBytes;
+    uint32_t count;     // records
+    uint32_t rawBytes;  // packed records before deflate
+    uint32_t bodyBytes;
+    uint32_t flags;
+    uint32_t rngBase;   // dice counter before the first record's delta
+    uint32_t bodyHash;  // FNV-1a of the body, against accidental damage
+};
+
+// A packed record starts with a byte: the type in the low nibble, a small
+// field in the high one. Type nibble 0, which no journaled command has,
+// escapes; the escape kind is in the high nibble.
+enum PackEscape {
+    ESC_RNG = 0,    // varint: extra dice draws before the next record
+    ESC_ARMIES = 1, // zigzag varint: the next record's armies, when not 1
+    ESC_TERR = 2,   // zigzag varint: the next record's territory, when it has none
+    ESC_RAW = 3     // a whole record: varint type, zigzag terr and armies, varint dice
+};
+
+bool hasTerr(uint8_t type) {
+    return type == CMD_PLACE || type == CMD_ATTACK_FROM || type == CMD_ATTACK_TO ||
+           type == CMD_FORTIFY_FROM || type == CMD_FORTIFY_TO;
+}
+
+uint32_t fnv1a(const unsigned char* p, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; ++i) h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+int32_t unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+void putVarint(std::vector<unsigned char> &out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((unsigned char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((unsigned char)v);
+}
+
+bool getVarint(const unsigned char* &p, const unsigned char* end, uint32_t &v) {
+    v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (p == end) return false;
+        unsigned char b = *p++;
+        v |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+void packRecords(const Journal &j, uint32_t rngBase, std::vector<unsigned char> &out) {
+    int32_t prevTerr = 0;
+    uint32_t prevRng = rngBase;
+    for (const JournalRecord &rec : j.records) {
+        uint8_t type = rec.type;
+        uint32_t dice = rec.rngCount - prevRng;
+        prevRng = rec.rngCount;
+        if (type == 0 || type > 15) {
+            out.push_back((unsigned char)(ESC_RAW << 4));
+            putVarint(out, type);
+            putVarint(out, zigzag(rec.terr));
+            putVarint(out, zigzag(rec.armies));
+            putVarint(out, dice);
+            continue;
+        }
+        // only attacks roll, seldom more than 7 dice
+        if (dice && (type != CMD_ATTACK_TO || dice > 7)) {
+            out.push_back((unsigned char)(ESC_RNG << 4));
+            putVarint(out, dice);
+            dice = 0;
+        }
+        if (type != CMD_FORTIFY_TO && rec.armies != 1) {
+            out.push_back((unsigned char)(ESC_ARMIES << 4));
+            putVarint(out, zigzag(rec.armies));
+        }
+        if (!hasTerr(type)) {
+            if (rec.terr != -1) {
+                out.push_back((unsigned char)(ESC_TERR << 4));
+                putVarint(out, zigzag(rec.terr));
+            }
+            out.push_back(type);
+            continue;
+        }
+
+        uint32_t delta = zigzag((int32_t)((uint32_t)rec.terr - (uint32_t)prevTerr));
+        prevTerr = rec.terr;
+        if (type == CMD_ATTACK_TO) {
+            out.push_back((unsigned char)(type | dice << 4));
+            putVarint(out, delta);
+        } else if (delta < 15) {
+            out.push_back((unsigned char)(type | (delta + 1) << 4));
+        } else {
+            out.push_back(type);
+            putVarint(out, delta);
+        }
+        if (type == CMD_FORTIFY_TO) putVarint(out, zigzag(rec.armies));
+    }
+}
+
+// exactly count records; each takes at least a byte, so what count can
+// make us reserve is bounded by the bytes actually there
+bool unpackRecords(const unsigned char* p, const unsigned char* end, uint32_t rngBase,
+                   uint32_t count, std::vector<JournalRecord> &records) {
+    int32_t prevTerr = 0;
+    uint32_t rng = rngBase;
+    int32_t armies = 1, terr = -1; // escaped values for the next record
+    records.clear();
+    records.reserve(std::min<size_t>(count, (size_t)(end - p)));
+    uint32_t v;
+    while (p < end) {
+        uint8_t head = *p++;
+        uint8_t type = head & 0x0f;
+        uint32_t small = head >> 4;
+        if (type == 0) {
+            if (small == ESC_RAW) {
+                if (records.size() == count) return false;
+                uint32_t t, tr, ar, dice;
+                if (!getVarint(p, end, t) || !getVarint(p, end, tr) ||
+                    !getVarint(p, end, ar) || !getVarint(p, end, dice) || t > 0xff) return false;
+                rng += dice;
+                records.push_back({(uint8_t)t, {0, 0, 0}, unzigzag(tr), unzigzag(ar), rng});
+                continue;
+            }
+            if (small > ESC_RAW || !getVarint(p, end, v)) return false;
+            if (small == ESC_RNG) rng += v;
+            else if (small == ESC_ARMIES) armies = unzigzag(v);
+            else terr = unzigzag(v);
+            continue;
+        }
+        if (records.size() == count) return false;
+        if (hasTerr(type)) {
+            if (type == CMD_ATTACK_TO) {
+                rng += small;
+                if (!getVarint(p, end, v)) return false;
+            } else if (small) {
+                v = small - 1;
+            } else if (!getVarint(p, end, v)) {
+                return false;
+            }
+            terr = (int32_t)((uint32_t)prevTerr + (uint32_t)unzigzag(v));
+            prevTerr = terr;
+            if (type == CMD_FORTIFY_TO) {
+                if (!getVarint(p, end, v)) return false;
+                armies = unzigzag(v);
+            }
+        }
+        records.push_back({type, {0, 0, 0}, terr, armies, rng});
+        armies = 1;
+        terr = -1;
+    }
+    return records.size() == count;
+}
+
+bool writeAll(int fd, const unsigned char* p, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+} // namespace
+
+JournalWriter::~JournalWriter() {
+    close();
+}
+
+bool JournalWriter::open(const char* file, const Game &start, bool sync, std::string &err) {
+    close();
+    path = file;
+    failure.clear();
+    fd = ::open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        err = path + ": cannot write";
+        return false;
+    }
+    syncTurns = sync;
+    lastPlayer = start.currentPlayer;
+
+    buf.resize(sizeof(JournalHeader) + snapshotMaxBytes(start));
+    size_t snapBytes = writeSnapshot(start, buf.data() + sizeof(JournalHeader));
+    JournalHeader hdr;
+    std::memcpy(hdr.magic, kMagic, sizeof(kMagic));
+    hdr.version = kVersion;
+    hdr.startBytes = (uint32_t)snapBytes;
+    std::memcpy(buf.data(), &hdr, sizeof(hdr));
+    buf.resize(sizeof(hdr) + snapBytes);
+    if (!flush(true)) {
+        err = failure;
+        return false;
+    }
+    buf.reserve(kBufferBytes);
+    return true;
+}
+
+JournalRecord journalRecord(const Command &cmd, const Game &after) {
+    JournalRecord rec;
+    std::memset(&rec, 0, sizeof(rec));
+    rec.type = (uint8_t)cmd.type;
+    rec.terr = cmd.terr;
+    rec.armies = cmd.armies;
+    rec.rngCount = (uint32_t)after.rngCount;
+    return rec;
+}
+
+bool JournalWriter::append(const Command &cmd, const Game &after) {
+    if (fd < 0) return false;
+    JournalRecord rec = journalRecord(cmd, after);
+    const unsigned char* p = (const unsigned char*)&rec;
+    buf.insert(buf.end(), p, p + sizeof(rec));
+
+    bool turnEnded = after.currentPlayer != lastPlayer || after.gameOver;
+    lastPlayer = after.currentPlayer;
+    if (turnEnded) return flush(syncTurns);
+    if (buf.size() + sizeof(rec) > kBufferBytes) return flush(false);
+    return true;
+}
+
+// on failure the file stops where the write did; anything after it would
+// leave a gap replay cannot cross
+bool JournalWriter::flush(bool sync) {
+    if (fd < 0) return false;
+    bool ok = writeAll(fd, buf.data(), buf.size());
+    if (ok && sync) ok = ::fdatasync(fd) == 0;
+    buf.clear();
+    if (ok) return true;
+    failure = path + ": " + std::strerror(errno);
+    ::close(fd);
+    fd = -1;
+    return false;
+}
+
+bool JournalWriter::close() {
+    if (fd < 0) return true;
+    bool ok = flush(true);
+    if (ok) ::close(fd);
+    fd = -1;
+    return ok;
+}
+
+bool isJournalFile(const char* path) {
+    FILE* f = std::fopen(path, "rb");
+    if (!f) return false;
+    char magic[8];
+    bool ok = std::fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+              (std::memcmp(magic, kMagic, sizeof(kMagic)) == 0 ||
+               std::memcmp(magic, kPackedMagic, sizeof(kPackedMagic)) == 0);
+    std::fclose(f);
+    return ok;
+}
+
+bool readJournal(const char* path, Journal &j, std::string &err) {
+    FILE* f = std::fopen(path, "rb");
+    if (!f) {
+        err = std::string(path) + ": cannot open";
+        return false;
+    }
+    std::vector<unsigned char> data;
+    unsigned char chunk[65536];
+    size_t got;
+    while ((got = std::fread(chunk, 1, sizeof(chunk), f)) > 0) data.insert(data.end(), chunk, chunk + got);
+    std::fclose(f);
+
+    if (!parseJournal(data.data(), data.size(), j, err)) {
+        err = std::string(path) + ": " + err;
+        return false;
+    }
+    return true;
+}
+
+bool parseJournal(const unsigned char* data, size_t len, Journal &j, std::string &err) {
+    if (len >= sizeof(PackedHeader) && std::memcmp(data, kPackedMagic, sizeof(kPackedMagic)) == 0) {
+        PackedHeader hdr;
+        std::memcpy(&hdr, data, sizeof(hdr));
+        if (hdr.version != kPackedVersion) { err = "unsupported journal version"; return false; }
+        if (len - sizeof(hdr) < (uint64_t)hdr.startBytes + hdr.bodyBytes) { err = "truncated journal"; return false; }
+        const unsigned char* p = data + sizeof(hdr);
+        j.start.assign(p, p + hdr.startBytes);
+        p += hdr.startBytes;
+
+        // nothing inflates past deflate's ratio; the header is checked
+        // before anything is allocated, and the rest as it is decoded, so
+        // a hostile file fails without costing more than its own size
+        uint64_t rawLimit = (hdr.flags & kDeflated) ? (uint64_t)hdr.bodyBytes * kMaxInflate : hdr.bodyBytes;
+        if (hdr.rawBytes > rawLimit || hdr.rawBytes > kMaxRawBytes ||
+            fnv1a(p, hdr.bodyBytes) != hdr.bodyHash) {
+            err = "corrupt journal";
+            return false;
+        }
+        std::vector<unsigned char> raw;
+        if (hdr.flags & kDeflated) {
+            if (!inflateRaw(p, hdr.bodyBytes, hdr.rawBytes, raw) || raw.size() != hdr.rawBytes) {
+                err = "corrupt journal";
+                return false;
+            }
+            p = raw.data();
+        } else if (hdr.bodyBytes != hdr.rawBytes) {
+            err = "corrupt journal";
+            return false;
+        }
+        if (!unpackRecords(p, p + hdr.rawBytes, hdr.rngBase, hdr.count, j.records)) {
+            err = "corrupt journal";
+            return false;
+        }
+        return true;
+    }
+
+    JournalHeader hdr;
+    if (len < sizeof(hdr)) { err = "not a journal"; return false; }
+    std::memcpy(&hdr, data, sizeof(hdr));
+    if (std::memcmp(hdr.magic, kMagic, sizeof(kMagic)) != 0) { err = "not a journal"; return false; }
+    if (hdr.version != kVersion) { err = "unsupported journal version"; return false; }
+    if (len - sizeof(hdr) < hdr.startBytes) { err = "truncated journal"; return false; }
+
+    const unsigned char* p = data + sizeof(hdr);
+    j.start.assign(p, p + hdr.startBytes);
+    p += hdr.startBytes;
+    size_t count = (size_t)(data + len - p) / sizeof(JournalRecord);
+    j.records.resize(count);
+    if (count) std::memcpy(j.records.data(), p, count * sizeof(JournalRecord));
+    return true;
+}
+
+void encodeJournal(const Journal &j, std::vector<unsigned char> &out) {
+    JournalHeader hdr;
+    std::memcpy(hdr.magic, kMagic, sizeof(kMagic));
+    hdr.version = kVersion;
+    hdr.startBytes = (uint32_t)j.start.size();
+    const unsigned char* h = (const unsigned char*)&hdr;
+    const unsigned char* r = (const unsigned char*)j.records.data();
+    out.reserve(out.size() + sizeof(hdr) + j.start.size() + j.records.size() * sizeof(JournalRecord));
+    out.insert(out.end(), h, h + sizeof(hdr));
+    out.insert(out.end(), j.start.begin(), j.start.end());
+    out.insert(out.end(), r, r + j.records.size() * sizeof(JournalRecord));
+}
+
+bool replayJournal(Game &g, const Journal &j, size_t count, std::string &err) {
+    if (!readSnapshot(g, j.start.data(), j.start.size(), err)) return false;
+    count = std::min(count, j.records.size());
+    for (size_t i = 0; i < count; ++i) {
+        const JournalRecord &rec = j.records[i];
+        Command cmd;
+        cmd.type = (CommandType)rec.type;
+        cmd.terr = rec.terr;
+        cmd.armies = rec.armies;
+        if (cmd.type == CMD_CLICK || !g.apply(cmd)) {
+            err = "journal record " + std::to_string(i) + " was rejected";
+            return false;
+        }
+        if ((uint32_t)g.rngCount != rec.rngCount) {
+            err = "journal record " + std::to_string(i) + ": dice diverged";
+            return false;
+        }
+    }
+    return true;
+}
+
+void packJournal(const Journal &j, bool deflate, std::vector<unsigned char> &out) {
+    PackedHeader hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    std::memcpy(hdr.magic, kPackedMagic, sizeof(kPackedMagic));
+    hdr.version = kPackedVersion;
+    hdr.startBytes = (uint32_t)j.start.size();
+    hdr.count = (uint32_t)j.records.size();
+    hdr.rngBase = j.records.empty() ? 0 : j.records[0].rngCount;
+
+    std::vector<unsigned char> raw;
+    raw.reserve(j.records.size() * 2);
+    packRecords(j, hdr.rngBase, raw);
+    hdr.rawBytes = (uint32_t)raw.size();
+
+    size_t at = out.size();
+    out.resize(at + sizeof(hdr));
+    out.insert(out.end(), j.start.begin(), j.start.end());
+    size_t body = out.size();
+    if (deflate) {
+        hdr.flags = kDeflated;
+        deflateRaw(raw.data(), raw.size(), out);
+    } else {
+        out.insert(out.end(), raw.begin(), raw.end());
+    }
+    hdr.bodyBytes = (uint32_t)(out.size() - body);
+    hdr.bodyHash = fnv1a(out.data() + body, hdr.bodyBytes);
+    std::memcpy(out.data() + at, &hdr, sizeof(hdr));
+}
@@ -0,0 +1,87 @@
+// journal.h
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "game.h"
+
+// Journal file: a header, the snapshot the game started from, then one
+// fixed-size record per accepted command. Replaying the records through
+// Game::apply from that snapshot rebuilds the game exactly; the dice
+// counter in each record catches a replay that drifts.
+struct JournalRecord {
+    uint8_t  type;      // CommandType, never CMD_CLICK
+    uint8_t  pad[3];
+    int32_t  terr;
+    int32_t  armies;
+    uint32_t rngCount;  // low bits of Game::rngCount after the command
+};
+
+// Appends records through a buffer. Each finished turn is written out,
+// and with syncTurns also fsynced, so a crash loses at most the turn in
+// progress. The first failed write or sync closes the journal: the file
+// keeps every record written before it and never a gap, so it still
+// replays, only shorter.
+class JournalWriter {
+public:
+    JournalWriter() = default;
+    ~JournalWriter();
+    JournalWriter(const JournalWriter&) = delete;
+    JournalWriter& operator=(const JournalWriter&) = delete;
+
+    // truncates path and writes the header and start state
+    bool open(const char* path, const Game &start, bool syncTurns, std::string &err);
+    bool isOpen() const { return fd >= 0; }
+
+    // cmd was just accepted by after.apply(cmd); false if the journal
+    // failed here or earlier, and error() says why
+    bool append(const Command &cmd, const Game &after);
+
+    bool flush(bool sync);
+    bool close(); // flushes and syncs; false if that failed
+    const std::string &error() const { return failure; }
+
+private:
+    int  fd = -1;
+    std::string path, failure;
+    bool syncTurns = false;
+    int  lastPlayer = 0;
+    std::vector<unsigned char> buf;
+};
+
+// a journal read back whole
+struct Journal {
+    std::vector<unsigned char> start; // snapshot the game began from
+    std::vector<JournalRecord> records;
+};
+
+// the record JournalWriter::append writes for cmd
+JournalRecord journalRecord(const Command &cmd, const Game &after);
+
+bool isJournalFile(const char* path);
+
+// a torn last record, from a crash mid-write, is dropped; any file is
+// safe to hand these, a damaged or hostile one just fails
+bool readJournal(const char* path, Journal &j, std::string &err);
+bool parseJournal(const unsigned char* data, size_t len, Journal &j, std::string &err);
+
+// appends the bytes a JournalWriter leaves in its file
+void encodeJournal(const Journal &j, std::vector<unsigned char> &out);
+
+// Packed journal, for archives and storage: each record becomes a byte
+// holding its type and a small field (the dice drawn by an attack, or a
+// territory close to the previous one), plus varints for whatever does
+// not fit: territory deltas, fortify armies, and escapes for anything
+// off the usual pattern, so every journal packs losslessly. With deflate
+// the stream is then compressed as one raw DEFLATE body. parseJournal
+// and readJournal take either form. Appends to out.
+void packJournal(const Journal &j, bool deflate, std::vector<unsigned char> &out);
+
+// g must be on the journal's map; restores the start and applies the
+// first count records
+bool replayJournal(Game &g, const Journal &j, size_t count, std::string &err);
+
+#endif
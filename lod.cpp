@@ -0,0 +1,265 @@
+// lod.cpp
+#include "lod.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace {
+
+float segDist2(float px, float py, float ax, float ay, float bx, float by) {
+    float dx = bx - ax, dy = by - ay;
+    float len2 = dx*dx + dy*dy;
+    float t = len2 > 0.0f ? ((px-ax)*dx + (py-ay)*dy) / len2 : 0.0f;
+    t = std::max(0.0f, std::min(1.0f, t));
+    float ex = ax + t*dx - px, ey = ay + t*dy - py;
+    return ex*ex + ey*ey;
+}
+
+// Douglas-Peucker over an open chain; endpoints are always kept
+void douglasPeucker(const std::vector<float> &xs, const std::vector<float> &ys,
+                    float tol, std::vector<char> &keep) {
+    int n = (int)xs.size();
+    keep.assign(n, 0);
+    keep[0] = keep[n-1] = 1;
+    float tol2 = tol * tol;
+
+    std::vector<std::pair<int,int>> stack;
+    stack.push_back({0, n-1});
+    while (!stack.empty()) {
+        int s = stack.back().first, e = stack.back().second;
+        stack.pop_back();
+        int best = -1;
+        float bestD = tol2;
+        for (int i = s+1; i < e; ++i) {
+            float d = segDist2(xs[i], ys[i], xs[s], ys[s], xs[e], ys[e]);
+            if (d > bestD) { bestD = d; best = i; }
+        }
+        if (best < 0) continue;
+        keep[best] = 1;
+        stack.push_back({s, best});
+        stack.push_back({best, e});
+    }
+}
+
+// Drops repeated vertices and spikes (a b a) from a closed ring, where
+// snapping folded it back on itself; under three vertices it is gone.
+void cleanRing(std::vector<uint32_t> &r) {
+    size_t n = 0;
+    for (uint32_t v : r) {
+        if (n > 0 && r[n-1] == v) continue;
+        if (n > 1 && r[n-2] == v) { --n; continue; }
+        r[n++] = v;
+    }
+    r.resize(n);
+    // and across the seam
+    for (;;) {
+        size_t m = r.size();
+        if (m > 1 && r[m-1] == r[0]) r.pop_back();
+        else if (m > 2 && r[m-2] == r[0]) r.pop_back();
+        else if (m > 2 && r[m-1] == r[1]) r.erase(r.begin());
+        else break;
+    }
+    if (r.size() < 3) r.clear();
+}
+
+uint64_t edgeKey(uint32_t a, uint32_t b) {
+    return ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+}
+
+} // namespace
+
+void buildLodArrays(const RingTopology &topo, float tol[MapData::kLodLevels],
+                    std::vector<uint32_t> &offsets, std::vector<uint32_t> &rings) {
+    const int kLevels = MapData::kLodLevels;
+    int numTerrs = (int)topo.polyStart.size() - 1;
+    size_t numVerts = topo.verts.size() / 2;
+    tol[0] = 0.0f;
+    for (int k = 1; k < kLevels; ++k) tol[k] = 0.0005f * (float)(1 << (k-1));
+
+    // which vertex speaks for a snapping cell: one on a coast or the map
+    // edge first, so those outlines keep to it, then the busiest junction
+    std::vector<uint32_t> rank(numVerts, 0);
+    {
+        std::unordered_map<uint64_t,uint32_t> runs;
+        runs.reserve(topo.ringVerts.size());
+        for (int p = 0; p < numTerrs; ++p) {
+            uint32_t base = topo.polyStart[p], n = topo.polyStart[p+1] - base;
+            for (uint32_t i = 0; i < n; ++i) {
+                runs[edgeKey(topo.ringVerts[base + i], topo.ringVerts[base + (i + 1) % n])]++;
+                rank[topo.ringVerts[base + i]]++;
+            }
+        }
+        for (const auto &r : runs) {
+            if (r.second != 1) continue;
+            rank[r.first >> 32] |= 1u << 31;
+            rank[(uint32_t)r.first] |= 1u << 31;
+        }
+    }
+
+    offsets.assign((size_t)kLevels * (numTerrs + 1), 0);
+    rings.assign(topo.ringVerts.begin(), topo.ringVerts.end());
+    std::copy(topo.polyStart.begin(), topo.polyStart.end(), offsets.begin());
+
+    struct LevelEdge {
+        uint32_t a, b;
+        int32_t  left, right;
+        uint32_t runs;
+    };
+    std::vector<uint32_t> cellOf(numVerts), cellRep, snapped, ring;
+    std::vector<uint32_t> lstart, deg, inc, chain;
+    std::vector<LevelEdge> edges;
+    std::vector<char> done, drop;
+    std::vector<float> cx, cy;
+    std::vector<char> chainKeep;
+    std::unordered_map<uint64_t,uint32_t> cells, edgeIdx;
+
+    for (int level = 1; level < kLevels; ++level) {
+        float t = tol[level];
+
+        // snap every vertex to the one speaking for its tol-sized cell;
+        // junctions closer than that merge, and territories that fit in
+        // one cell fold away, taken up by their neighbors
+        cells.clear();
+        cellRep.clear();
+        for (uint32_t v = 0; v < numVerts; ++v) {
+            int32_t gx = (int32_t)std::floor(topo.verts[2*v] / t);
+            int32_t gy = (int32_t)std::floor(topo.verts[2*v+1] / t);
+            auto ins = cells.emplace(((uint64_t)(uint32_t)gx << 32) | (uint32_t)gy, (uint32_t)cellRep.size());
+            if (ins.second) cellRep.push_back(v);
+            else if (rank[v] > rank[cellRep[ins.first->second]]) cellRep[ins.first->second] = v;
+            cellOf[v] = ins.first->second;
+        }
+        lstart.assign(1, 0);
+        snapped.clear();
+        for (int p = 0; p < numTerrs; ++p) {
+            ring.clear();
+            for (uint32_t k = topo.polyStart[p]; k < topo.polyStart[p+1]; ++k) {
+                ring.push_back(cellRep[cellOf[topo.ringVerts[k]]]);
+            }
+            cleanRing(ring);
+            snapped.insert(snapped.end(), ring.begin(), ring.end());
+            lstart.push_back((uint32_t)snapped.size());
+        }
+
+        // the snapped borders, each once with the territories either side
+        edges.clear();
+        edgeIdx.clear();
+        for (int p = 0; p < numTerrs; ++p) {
+            uint32_t base = lstart[p], n = lstart[p+1] - base;
+            for (uint32_t i = 0; i < n; ++i) {
+                uint32_t a = snapped[base + i], b = snapped[base + (i + 1) % n];
+                auto ins = edgeIdx.emplace(edgeKey(a, b), (uint32_t)edges.size());
+                if (ins.second) {
+                    edges.push_back({a, b, p, -1, 1});
+                } else {
+                    LevelEdge &e = edges[ins.first->second];
+                    e.runs++;
+                    if (e.right < 0 && e.left != p) e.right = p;
+                }
+            }
+        }
+
+        // a vertex is a junction unless exactly two edges meet there with
+        // the same territories either side; chains run between junctions
+        deg.assign(numVerts, 0);
+        inc.resize(2 * numVerts);
+        for (uint32_t e = 0; e < (uint32_t)edges.size(); ++e) {
+            for (uint32_t v : {edges[e].a, edges[e].b}) {
+                if (deg[v] < 2) inc[2*v + deg[v]] = e;
+                deg[v]++;
+            }
+        }
+        auto sides = [&](const LevelEdge &e) {
+            return edgeKey((uint32_t)e.left, (uint32_t)e.right);
+        };
+        auto junction = [&](uint32_t v) {
+            if (deg[v] != 2) return true;
+            const LevelEdge &e0 = edges[inc[2*v]], &e1 = edges[inc[2*v+1]];
+            return e0.runs > 2 || e1.runs > 2 || sides(e0) != sides(e1);
+        };
+
+        // simplify each chain once, so both sides drop the same vertices
+        done.assign(edges.size(), 0);
+        drop.assign(numVerts, 0);
+        auto simplify = [&]() {
+            int m = (int)chain.size();
+            if (m <= 2) return;
+            cx.clear(); cy.clear();
+            for (uint32_t v : chain) {
+                cx.push_back(topo.verts[2*v]);
+                cy.push_back(topo.verts[2*v+1]);
+            }
+            douglasPeucker(cx, cy, t, chainKeep);
+            for (int k = 1; k + 1 < m; ++k) if (!chainKeep[k]) drop[chain[k]] = 1;
+        };
+        auto walk = [&](uint32_t v, uint32_t e) {
+            chain.assign(1, v);
+            for (;;) {
+                done[e] = 1;
+                v = edges[e].a == v ? edges[e].b : edges[e].a;
+                chain.push_back(v);
+                if (junction(v) || v == chain[0]) return;
+                e = inc[2*v] == e ? inc[2*v+1] : inc[2*v];
+            }
+        };
+        for (uint32_t e = 0; e < (uint32_t)edges.size(); ++e) {
+            if (done[e]) continue;
+            if (junction(edges[e].a)) walk(edges[e].a, e);
+            else if (junction(edges[e].b)) walk(edges[e].b, e);
+            else continue;
+            simplify();
+        }
+        // what is left are closed loops with no junction at all, islands
+        // in the sea or in one neighbor: split at the vertex farthest from
+        // the start and simplify both halves
+        for (uint32_t e = 0; e < (uint32_t)edges.size(); ++e) {
+            if (done[e]) continue;
+            walk(edges[e].a, e);
+            int m = (int)chain.size(), far = 0;
+            float farD = -1.0f;
+            for (int k = 0; k < m; ++k) {
+                float dx = topo.verts[2*chain[k]] - topo.verts[2*chain[0]];
+                float dy = topo.verts[2*chain[k]+1] - topo.verts[2*chain[0]+1];
+                if (dx*dx + dy*dy > farD) { farD = dx*dx + dy*dy; far = k; }
+            }
+            std::vector<uint32_t> loop;
+            loop.swap(chain);
+            chain.assign(loop.begin(), loop.begin() + far + 1);
+            simplify();
+            chain.assign(loop.begin() + far, loop.end());
+            simplify();
+        }
+
+        uint32_t* off = &offsets[(size_t)level * (numTerrs + 1)];
+        for (int p = 0; p < numTerrs; ++p) {
+            off[p] = (uint32_t)rings.size();
+            ring.clear();
+            for (uint32_t k = lstart[p]; k < lstart[p+1]; ++k) {
+                if (!drop[snapped[k]]) ring.push_back(snapped[k]);
+            }
+            cleanRing(ring);
+            rings.insert(rings.end(), ring.begin(), ring.end());
+        }
+        off[numTerrs] = (uint32_t)rings.size();
+    }
+}
+
+int PolyLod::levelFor(float pixelWorldSize) const {
+    for (int k = levels() - 1; k > 0; --k) {
+        if (map->lodTol[k] <= pixelWorldSize) return k;
+    }
+    return 0;
+}
+
+void PolyLod::appendLines(int level, int terrIdx, std::vector<uint32_t> &out) const {
+    int n;
+    const uint32_t* r = ring(level, terrIdx, n);
+    for (int k = 0; k < n; ++k) {
+        const MapEdge &e = map->edges[r[k] & ~MapData::kReversed];
+        int across = e.left == terrIdx ? e.right : e.left;
+        if (across >= 0 && across < terrIdx) continue;
+        bool rev = (r[k] & MapData::kReversed) != 0;
+        out.push_back(rev ? e.v1 : e.v0);
+        out.push_back(rev ? e.v0 : e.v1);
+    }
+}
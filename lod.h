@@ -0,0 +1,64 @@
+// lod.h
+#ifndef LOD_H
+#define LOD_H
+
+#include <cstdint>
+#include <vector>
+#include "map.h"
+
+// Rings over a shared vertex pool, as MapData::compile sees them.
+struct RingTopology {
+    const std::vector<float>    &verts;     // pool, x,y interleaved
+    const std::vector<uint32_t> &polyStart; // territories+1, into ringVerts
+    const std::vector<uint32_t> &ringVerts; // pool index per ring vertex
+};
+
+// Territory outlines pre-simplified at several tolerances, run once by
+// MapData::compile. Each coarser level first snaps vertices to a grid of
+// its tolerance, merging nearby junctions and folding away territories
+// smaller than a cell, then runs Douglas-Peucker once over each border
+// chain between junctions. Both steps decide per pool vertex, so the two
+// sides of a border stay watertight. offsets holds kLodLevels * (terrs+1)
+// entries into rings, which lists pool vertices in ring order; a folded
+// territory has an empty ring.
+void buildLodArrays(const RingTopology &topo, float tol[MapData::kLodLevels],
+                    std::vector<uint32_t> &offsets, std::vector<uint32_t> &rings);
+
+// view over the levels stored in a MapData
+class PolyLod {
+public:
+    void bind(const MapData &m) { map = &m; }
+
+    // level 0 is full resolution
+    int levels() const { return (int)map->numLevels; }
+
+    // coarsest level whose tolerance is below one screen pixel
+    int levelFor(float pixelWorldSize) const;
+
+    // ring edges at a level, in order; MapData::edgeFrom gives each
+    // one's first vertex
+    const uint32_t* ring(int level, int terrIdx, int &count) const {
+        const uint32_t* off = &map->ringStart[(size_t)level * (map->numTerrs + 1)];
+        count = (int)(off[terrIdx+1] - off[terrIdx]);
+        return map->ringEdges.ptr + off[terrIdx];
+    }
+
+    // triangles filling that ring, three pool indices each
+    const uint32_t* triangles(int level, int terrIdx, int &count) const {
+        const uint32_t* off = &map->triStart[(size_t)level * (map->numTerrs + 1)];
+        count = (int)(off[terrIdx+1] - off[terrIdx]);
+        return map->tris.ptr + off[terrIdx];
+    }
+
+    // Appends the outline segments a territory owns at a level, as pool
+    // index pairs. A border belongs to its lower-index side, so lines built
+    // over any set of territories list each shared border once.
+    void appendLines(int level, int terrIdx, std::vector<uint32_t> &out) const;
+
+    float tolerance(int level) const { return map->lodTol[level]; }
+
+private:
+    const MapData* map = nullptr;
+};
+
+#endif
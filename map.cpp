@@ -0,0 +1,479 @@
+// map.cpp
+#include "map.h"
+#include "lod.h"
+#include "mapfile.h"
+#include "pick.h"
+#include <algorithm>
+#include <type_traits>
+#include <unordered_map>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char     kMagic[8] = {'R','I','S','K','M','A','P','1'};
+const uint32_t kVersion  = 5;
+const size_t   kAlign    = 64; // every section starts on a cache line
+
+enum Section {
+    SEC_VERTS = 0,
+    SEC_LABELS,
+    SEC_COLORS,
+    SEC_BOUNDS,
+    SEC_CONTINENT_OF,
+    SEC_ADJ_START,
+    SEC_ADJ_LIST,
+    SEC_CONTINENTS,
+    SEC_NAME_START,
+    SEC_NAMES,
+    SEC_EDGES,
+    SEC_EDGE_START,
+    SEC_RING_START,
+    SEC_RING_EDGES,
+    SEC_TRI_START,
+    SEC_TRIS,
+    SEC_GRID_CELLS,
+    SEC_GRID_ITEMS,
+    SEC_COUNT
+};
+
+struct SectionEntry {
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+// native byte order; the image is a cache, not an interchange format
+struct ImageHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t headerBytes;
+    uint64_t imageBytes;
+    uint64_t fingerprint;  // FNV-1a over everything after the header
+    uint32_t numTerrs;
+    uint32_t numVerts;
+    uint32_t numContinents;
+    uint32_t numLevels;
+    char     name[64];
+    float    lodTol[MapData::kLodLevels];
+    GridMeta grid;
+    SectionEntry sections[SEC_COUNT];
+};
+
+struct ImageWriter {
+    std::vector<unsigned char> buf;
+    ImageHeader hdr;
+
+    ImageWriter() {
+        std::memset(&hdr, 0, sizeof(hdr));
+        buf.resize(sizeof(ImageHeader));
+    }
+
+    template <typename T>
+    void section(Section id, const std::vector<T> &v) {
+        buf.resize((buf.size() + kAlign - 1) / kAlign * kAlign);
+        hdr.sections[id].offset = buf.size();
+        hdr.sections[id].bytes  = v.size() * sizeof(T);
+        const unsigned char* p = (const unsigned char*)v.data();
+        buf.insert(buf.end(), p, p + v.size() * sizeof(T));
+    }
+
+    void finish() {
+        hdr.imageBytes = buf.size();
+        uint64_t h = 1469598103934665603ULL;
+        for (size_t i = sizeof(ImageHeader); i < buf.size(); ++i) h = (h ^ buf[i]) * 1099511628211ULL;
+        hdr.fingerprint = h;
+        std::memcpy(buf.data(), &hdr, sizeof(hdr));
+    }
+};
+
+float cross(float ax, float ay, float bx, float by, float cx, float cy) {
+    return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+}
+
+// Ear clipping over the pool vertices ring[0..m); emits triangles as pool
+// indices. Degenerate leftovers become a fan.
+void earClip(const std::vector<float> &verts, const uint32_t* ring, int m, std::vector<uint32_t> &out) {
+    if (m < 3) return;
+    std::vector<int> idx(m);
+    double area = 0.0;
+    for (int i = 0, j = m - 1; i < m; j = i++) {
+        area += (double)verts[2*ring[j]] * verts[2*ring[i]+1] - (double)verts[2*ring[i]] * verts[2*ring[j]+1];
+    }
+    // walk counter-clockwise
+    for (int i = 0; i < m; ++i) idx[i] = area >= 0.0 ? i : m - 1 - i;
+
+    auto X = [&](int k) { return verts[2*ring[idx[k]]]; };
+    auto Y = [&](int k) { return verts[2*ring[idx[k]]+1]; };
+
+    int n = m;
+    int guard = 0;
+    for (int i = 0; n > 3 && guard < n; ) {
+        int a = (i + n - 1) % n, b = i % n, c = (i + 1) % n;
+        bool ear = cross(X(a), Y(a), X(b), Y(b), X(c), Y(c)) > 0.0f;
+        for (int k = 0; ear && k < n; ++k) {
+            if (k == a || k == b || k == c) continue;
+            float px = X(k), py = Y(k);
+            if (cross(X(a), Y(a), X(b), Y(b), px, py) >= 0.0f &&
+                cross(X(b), Y(b), X(c), Y(c), px, py) >= 0.0f &&
+                cross(X(c), Y(c), X(a), Y(a), px, py) >= 0.0f) ear = false;
+        }
+        if (ear) {
+            out.push_back(ring[idx[a]]);
+            out.push_back(ring[idx[b]]);
+            out.push_back(ring[idx[c]]);
+            idx.erase(idx.begin() + b);
+            --n;
+            guard = 0;
+            i = b;
+        } else {
+            ++i;
+            ++guard;
+        }
+    }
+    for (int k = 1; k + 1 < n; ++k) {
+        out.push_back(ring[idx[0]]);
+        out.push_back(ring[idx[k]]);
+        out.push_back(ring[idx[k+1]]);
+    }
+}
+
+// Appends one level's outlines: each border segment once, with the
+// territory on either side, and every ring as its list of segments.
+// start/ring give the level's rings as pool vertices.
+void addLevel(const uint32_t* start, const uint32_t* ring, uint32_t n,
+              std::vector<MapEdge> &edges, std::vector<uint32_t> &ringStart,
+              std::vector<uint32_t> &ringEdges) {
+    std::unordered_map<uint64_t,uint32_t> edgeIdx;
+    edgeIdx.reserve(start[n] - start[0]);
+    for (uint32_t t = 0; t < n; ++t) {
+        ringStart.push_back((uint32_t)ringEdges.size());
+        uint32_t base = start[t], m = start[t+1] - base;
+        for (uint32_t i = 0; i < m; ++i) {
+            uint32_t a = ring[base + i], b = ring[base + (i + 1) % m];
+            uint64_t key = ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+            auto ins = edgeIdx.emplace(key, (uint32_t)edges.size());
+            if (ins.second) {
+                edges.push_back({a, b, (int32_t)t, -1});
+            } else {
+                MapEdge &e = edges[ins.first->second];
+                if (e.right < 0 && e.left != (int32_t)t) e.right = (int32_t)t;
+            }
+            const MapEdge &e = edges[ins.first->second];
+            ringEdges.push_back(ins.first->second | (e.v0 == a ? 0 : MapData::kReversed));
+        }
+    }
+    ringStart.push_back((uint32_t)ringEdges.size());
+}
+
+uint64_t vertKey(float x, float y) {
+    if (x == 0.0f) x = 0.0f; // -0 and +0 are the same point
+    if (y == 0.0f) y = 0.0f;
+    uint32_t bx, by;
+    std::memcpy(&bx, &x, 4);
+    std::memcpy(&by, &y, 4);
+    return ((uint64_t)bx << 32) | by;
+}
+
+bool endsWith(const std::string &s, const char* suffix) {
+    size_t n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+} // namespace
+
+MapData::~MapData() {
+    if (mapped) munmap(mapped, mappedLen);
+}
+
+std::shared_ptr<const MapData> MapData::compile(const MapSource &src) {
+    uint32_t n = (uint32_t)src.terrs.size();
+
+    std::vector<float> verts, labels, colors, bounds;
+    std::vector<uint32_t> polyStart, ringVerts, adjStart, adjList, nameStart;
+    std::vector<int32_t> continentOf;
+    std::vector<char> names;
+
+    // vertex pool: bit-identical points are one vertex
+    size_t ringTotal = 0;
+    for (const TerritorySource &t : src.terrs) ringTotal += t.polyX.size();
+    std::unordered_map<uint64_t,uint32_t> poolIdx;
+    poolIdx.reserve(ringTotal);
+    ringVerts.reserve(ringTotal);
+
+    for (const TerritorySource &t : src.terrs) {
+        polyStart.push_back((uint32_t)ringVerts.size());
+        float minX = t.labelX, minY = t.labelY, maxX = t.labelX, maxY = t.labelY;
+        for (size_t k = 0; k < t.polyX.size(); ++k) {
+            auto ins = poolIdx.emplace(vertKey(t.polyX[k], t.polyY[k]), (uint32_t)(verts.size() / 2));
+            if (ins.second) {
+                verts.push_back(t.polyX[k]);
+                verts.push_back(t.polyY[k]);
+            }
+            ringVerts.push_back(ins.first->second);
+            if (k == 0) { minX = maxX = t.polyX[0]; minY = maxY = t.polyY[0]; }
+            minX = std::min(minX, t.polyX[k]); maxX = std::max(maxX, t.polyX[k]);
+            minY = std::min(minY, t.polyY[k]); maxY = std::max(maxY, t.polyY[k]);
+        }
+        labels.push_back(t.labelX);
+        labels.push_back(t.labelY);
+        colors.push_back(t.r);
+        colors.push_back(t.g);
+        colors.push_back(t.b);
+        bounds.push_back(minX); bounds.push_back(minY);
+        bounds.push_back(maxX); bounds.push_back(maxY);
+        continentOf.push_back(t.continent);
+
+        // rows sorted, so isAdjacent can binary-search
+        adjStart.push_back((uint32_t)adjList.size());
+        for (int nb : t.neighbors) adjList.push_back((uint32_t)nb);
+        std::sort(adjList.begin() + adjStart.back(), adjList.end());
+
+        nameStart.push_back((uint32_t)names.size());
+        names.insert(names.end(), t.name.begin(), t.name.end());
+    }
+    polyStart.push_back((uint32_t)ringVerts.size());
+    adjStart.push_back((uint32_t)adjList.size());
+    nameStart.push_back((uint32_t)names.size());
+
+    std::vector<ContinentRec> continents(src.continents.size());
+    for (size_t i = 0; i < src.continents.size(); ++i) {
+        std::memset(&continents[i], 0, sizeof(ContinentRec));
+        std::strncpy(continents[i].name, src.continents[i].name.c_str(), sizeof(continents[i].name) - 1);
+        continents[i].bonus = src.continents[i].bonus;
+    }
+
+    // full-resolution outlines, then each coarser level that draws at most
+    // three quarters of the last one kept; one that saves less would cost
+    // as much again in the image for little
+    std::vector<MapEdge> edges;
+    std::vector<uint32_t> edgeStart(1, 0), ringStart, ringEdges;
+    addLevel(polyStart.data(), ringVerts.data(), n, edges, ringStart, ringEdges);
+    edgeStart.push_back((uint32_t)edges.size());
+
+    float tol[kLodLevels], levelTol[kLodLevels] = {};
+    std::vector<uint32_t> lodStart, lodRings;
+    RingTopology topo = {verts, polyStart, ringVerts};
+    buildLodArrays(topo, tol, lodStart, lodRings);
+    std::vector<const uint32_t*> kept(1, &lodStart[0]);
+    for (int level = 1; level < kLodLevels; ++level) {
+        const uint32_t* off = &lodStart[(size_t)level * (n + 1)];
+        const uint32_t* prev = kept.back();
+        if ((uint64_t)(off[n] - off[0]) * 4 > (uint64_t)(prev[n] - prev[0]) * 3) continue;
+        levelTol[kept.size()] = tol[level];
+        kept.push_back(off);
+        addLevel(off, lodRings.data(), n, edges, ringStart, ringEdges);
+        edgeStart.push_back((uint32_t)edges.size());
+    }
+
+    std::vector<uint32_t> triStart, tris;
+    for (const uint32_t* off : kept) {
+        for (uint32_t t = 0; t < n; ++t) {
+            triStart.push_back((uint32_t)tris.size());
+            earClip(verts, &lodRings[off[t]], (int)(off[t+1] - off[t]), tris);
+        }
+        triStart.push_back((uint32_t)tris.size());
+    }
+
+    GridMeta grid;
+    std::vector<uint32_t> gridCells, gridItems;
+    buildGridArrays(bounds, grid, gridCells, gridItems);
+
+    ImageWriter w;
+    std::memcpy(w.hdr.magic, kMagic, sizeof(kMagic));
+    w.hdr.version = kVersion;
+    w.hdr.headerBytes = sizeof(ImageHeader);
+    w.hdr.numTerrs = n;
+    w.hdr.numVerts = (uint32_t)(verts.size() / 2);
+    w.hdr.numContinents = (uint32_t)continents.size();
+    w.hdr.numLevels = (uint32_t)kept.size();
+    std::strncpy(w.hdr.name, src.name.c_str(), sizeof(w.hdr.name) - 1);
+    std::memcpy(w.hdr.lodTol, levelTol, sizeof(levelTol));
+    w.hdr.grid = grid;
+    w.section(SEC_VERTS, verts);
+    w.section(SEC_LABELS, labels);
+    w.section(SEC_COLORS, colors);
+    w.section(SEC_BOUNDS, bounds);
+    w.section(SEC_CONTINENT_OF, continentOf);
+    w.section(SEC_ADJ_START, adjStart);
+    w.section(SEC_ADJ_LIST, adjList);
+    w.section(SEC_CONTINENTS, continents);
+    w.section(SEC_NAME_START, nameStart);
+    w.section(SEC_NAMES, names);
+    w.section(SEC_EDGES, edges);
+    w.section(SEC_EDGE_START, edgeStart);
+    w.section(SEC_RING_START, ringStart);
+    w.section(SEC_RING_EDGES, ringEdges);
+    w.section(SEC_TRI_START, triStart);
+    w.section(SEC_TRIS, tris);
+    w.section(SEC_GRID_CELLS, gridCells);
+    w.section(SEC_GRID_ITEMS, gridItems);
+    w.finish();
+
+    std::shared_ptr<MapData> map(new MapData());
+    map->owned.swap(w.buf);
+    map->image = map->owned.data();
+    map->imageLen = map->owned.size();
+    std::string err;
+    map->bind(err); // our own image, always consistent
+    return map;
+}
+
+std::shared_ptr<const MapData> MapData::load(const char* path, std::string &err) {
+    if (!endsWith(path, ".rmap")) {
+        MapSource src;
+        if (!loadMapText(path, src, err)) return nullptr;
+        return compile(src);
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        err = std::string(path) + ": cannot open";
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ImageHeader)) {
+        close(fd);
+        err = std::string(path) + ": too small for a map image";
+        return nullptr;
+    }
+    size_t len = (size_t)st.st_size;
+    void* base = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        err = std::string(path) + ": mmap failed";
+        return nullptr;
+    }
+
+    std::shared_ptr<MapData> map(new MapData());
+    map->mapped = base;
+    map->mappedLen = len;
+    map->image = (const unsigned char*)base;
+    map->imageLen = len;
+    if (!map->bind(err)) {
+        err = std::string(path) + ": " + err;
+        return nullptr;
+    }
+    return map;
+}
+
+bool MapData::bind(std::string &err) {
+    ImageHeader hdr;
+    std::memcpy(&hdr, image, sizeof(hdr));
+    if (std::memcmp(hdr.magic, kMagic, sizeof(kMagic)) != 0) { err = "not a map image"; return false; }
+    if (hdr.version != kVersion || hdr.headerBytes != sizeof(ImageHeader) ||
+        hdr.numLevels < 1 || hdr.numLevels > (uint32_t)kLodLevels) {
+        err = "map image from another version, recompile it";
+        return false;
+    }
+    if (hdr.imageBytes != imageLen) { err = "truncated map image"; return false; }
+
+    bool ok = true;
+    auto get = [&](auto &span, Section id, size_t expect) {
+        typedef typename std::remove_reference<decltype(span[0])>::type Elem;
+        const SectionEntry &s = hdr.sections[id];
+        if (s.offset % kAlign != 0 || s.offset > imageLen || s.bytes > imageLen - s.offset ||
+            s.bytes % sizeof(Elem) != 0) {
+            ok = false;
+            return;
+        }
+        span.ptr = (const typename std::remove_const<Elem>::type*)(image + s.offset);
+        span.count = s.bytes / sizeof(Elem);
+        if (expect != (size_t)-1 && span.count != expect) ok = false;
+    };
+
+    const size_t any = (size_t)-1;
+    size_t n = hdr.numTerrs;
+    size_t lodN = (size_t)hdr.numLevels * (n + 1);
+    get(verts,       SEC_VERTS,        (size_t)hdr.numVerts * 2);
+    get(labels,      SEC_LABELS,       n * 2);
+    get(colors,      SEC_COLORS,       n * 3);
+    get(bounds,      SEC_BOUNDS,       n * 4);
+    get(continentOf, SEC_CONTINENT_OF, n);
+    get(adjStart,    SEC_ADJ_START,    n + 1);
+    get(adjList,     SEC_ADJ_LIST,     any);
+    get(continents,  SEC_CONTINENTS,   hdr.numContinents);
+    get(nameStart,   SEC_NAME_START,   n + 1);
+    get(names,       SEC_NAMES,        any);
+    get(edges,       SEC_EDGES,        any);
+    get(edgeStart,   SEC_EDGE_START,   (size_t)hdr.numLevels + 1);
+    get(ringStart,   SEC_RING_START,   lodN);
+    get(ringEdges,   SEC_RING_EDGES,   any);
+    get(triStart,    SEC_TRI_START,    lodN);
+    get(tris,        SEC_TRIS,         any);
+    get(gridCells,   SEC_GRID_CELLS,   (size_t)hdr.grid.nx * hdr.grid.ny + 1);
+    get(gridItems,   SEC_GRID_ITEMS,   any);
+
+    // the closing offsets must land exactly on the arrays they index
+    ok = ok && adjStart[n] == adjList.count &&
+         nameStart[n] == names.count &&
+         edgeStart[hdr.numLevels] == edges.count &&
+         ringStart[lodN - 1] == ringEdges.count &&
+         triStart[lodN - 1] == tris.count &&
+         gridCells[gridCells.count - 1] == gridItems.count;
+
+    // and everything they index has to be in range, or a damaged file
+    // reads wild memory later; one pass over the image
+    auto rising = [](const Span<uint32_t> &s) {
+        if (s.count == 0 || s[0] != 0) return false;
+        for (size_t i = 1; i < s.count; ++i) if (s[i] < s[i-1]) return false;
+        return true;
+    };
+    auto below = [](const Span<uint32_t> &s, size_t limit) {
+        for (uint32_t v : s) if (v >= limit) return false;
+        return true;
+    };
+    ok = ok && rising(adjStart) && rising(nameStart) && rising(edgeStart) &&
+         rising(ringStart) && rising(triStart) && rising(gridCells) &&
+         below(tris, hdr.numVerts) && below(adjList, n) && below(gridItems, n);
+    for (size_t e = 0; ok && e < edges.count; ++e) {
+        const MapEdge &m = edges[e];
+        ok = m.v0 < hdr.numVerts && m.v1 < hdr.numVerts &&
+             m.left >= 0 && (size_t)m.left < n && m.right >= -1 && m.right < (int64_t)n;
+    }
+    for (size_t t = 0; ok && t < n; ++t) {
+        ok = continentOf[t] >= -1 && continentOf[t] < (int64_t)hdr.numContinents;
+    }
+    // a level's rings only use that level's edges
+    for (size_t l = 0; ok && l < hdr.numLevels; ++l) {
+        const uint32_t* off = &ringStart[l * (n + 1)];
+        for (uint32_t i = off[0]; ok && i < off[n]; ++i) {
+            uint32_t e = ringEdges[i] & ~kReversed;
+            ok = e >= edgeStart[l] && e < edgeStart[l+1];
+        }
+    }
+    if (!ok) {
+        err = "corrupt map image";
+        return false;
+    }
+
+    hdr.name[sizeof(hdr.name) - 1] = '\0';
+    name = hdr.name;
+    numTerrs = hdr.numTerrs;
+    numVerts = hdr.numVerts;
+    numLevels = hdr.numLevels;
+    fingerprint = hdr.fingerprint;
+    std::memcpy(lodTol, hdr.lodTol, sizeof(lodTol));
+    grid = hdr.grid;
+    return true;
+}
+
+bool MapData::save(const char* path, std::string &err) const {
+    std::string tmp = std::string(path) + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) {
+        err = std::string(path) + ": cannot write";
+        return false;
+    }
+    bool ok = std::fwrite(image, 1, imageLen, f) == imageLen;
+    ok = (std::fclose(f) == 0) && ok;
+    if (ok) ok = std::rename(tmp.c_str(), path) == 0;
+    if (!ok) {
+        std::remove(tmp.c_str());
+        err = std::string(path) + ": write failed";
+    }
+    return ok;
+}
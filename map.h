@@ -0,0 +1,160 @@
+// map.h
+#ifndef MAP_H
+#define MAP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// read-only view of an array inside a map image
+template <typename T>
+struct Span {
+    const T* ptr = nullptr;
+    size_t count = 0;
+
+    const T& operator[](size_t i) const { return ptr[i]; }
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + count; }
+    size_t size() const { return count; }
+};
+
+struct Continent {
+    std::string name;
+    int bonus;
+};
+
+// Editable form of a map, as parsed from text or built in code.
+// Coordinates are world units ([-1,1] for the whole globe).
+struct TerritorySource {
+    std::string name;
+    int continent = -1;
+    float r = 0.5f, g = 0.5f, b = 0.5f;
+    float labelX = 0.0f, labelY = 0.0f;
+    std::vector<float> polyX, polyY; // open ring
+    std::vector<int> neighbors;
+};
+
+struct MapSource {
+    std::string name;
+    std::vector<TerritorySource> terrs;
+    std::vector<Continent> continents;
+};
+
+// fixed-size records stored in the image
+struct ContinentRec {
+    char    name[32];
+    int32_t bonus;
+    int32_t reserved;
+};
+
+// one border segment, stored once for both territories on it
+struct MapEdge {
+    uint32_t v0, v1;  // pool vertices, in the left territory's ring order
+    int32_t  left;    // territory whose ring runs v0 -> v1
+    int32_t  right;   // territory on the other side, -1 for coast / map edge
+};
+
+struct GridMeta {
+    float    x0, y0;             // grid origin (world)
+    float    invCellW, invCellH;
+    uint32_t nx, ny;
+};
+
+// Immutable map geometry and topology as flat, aligned arrays in a single
+// image. compile() builds the image in memory; save() writes it out as a
+// .rmap file that load() maps and uses in place, with no parsing and no
+// per-territory allocation. Games share one MapData through shared_ptr.
+class MapData {
+public:
+    static const int kLodLevels = 6; // most levels an image holds
+    static const uint32_t kReversed = 0x80000000u;
+
+    ~MapData();
+    MapData(const MapData&) = delete;
+    MapData& operator=(const MapData&) = delete;
+
+    // .rmap files are mapped, anything else is parsed as a text map
+    static std::shared_ptr<const MapData> load(const char* path, std::string &err);
+    static std::shared_ptr<const MapData> compile(const MapSource &src);
+
+    bool save(const char* path, std::string &err) const;
+
+    std::string name;
+    uint32_t numTerrs = 0;
+    uint32_t numVerts = 0;     // distinct vertices in the pool
+    uint32_t numLevels = 0;    // LOD levels stored, each well under the last
+    uint64_t fingerprint = 0;  // hash of the image; saved games name their map by it
+
+    Span<float>    verts;      // vertex pool, x,y interleaved, no duplicates
+    Span<float>    labels;     // x,y per territory
+    Span<float>    colors;     // r,g,b per territory
+    Span<float>    bounds;     // minX,minY,maxX,maxY per territory
+    Span<int32_t>  continentOf;
+    Span<uint32_t> adjStart;   // numTerrs+1, CSR into adjList
+    Span<uint32_t> adjList;    // each row sorted ascending
+    Span<ContinentRec> continents;
+    Span<uint32_t> nameStart;  // numTerrs+1, into names
+    Span<char>     names;
+
+    // Outlines per LOD level, level 0 at full resolution. Each level's
+    // border segments are stored once in edges; a territory's ring is the
+    // list of its edges in order, and the triangles filling it index the
+    // vertex pool directly. Rings and triangles use level*(numTerrs+1)
+    // offsets.
+    float          lodTol[kLodLevels] = {};
+    Span<MapEdge>  edges;
+    Span<uint32_t> edgeStart;  // numLevels+1, into edges
+    Span<uint32_t> ringStart;  // into ringEdges
+    Span<uint32_t> ringEdges;  // edge id per ring edge, kReversed if run v1 -> v0
+    Span<uint32_t> triStart;   // into tris
+    Span<uint32_t> tris;       // pool indices, three per triangle
+
+    // uniform grid over territory bounds, see SpatialGrid
+    GridMeta       grid = {};
+    Span<uint32_t> gridCells;  // nx*ny+1
+    Span<uint32_t> gridItems;
+
+    // first pool vertex of a ring edge, in the ring's direction
+    uint32_t edgeFrom(uint32_t ref) const {
+        const MapEdge &e = edges[ref & ~kReversed];
+        return ref & kReversed ? e.v1 : e.v0;
+    }
+
+    // full-resolution ring
+    int   ringSize(int t) const { return (int)(ringStart[t+1] - ringStart[t]); }
+    uint32_t ringVert(int t, int i) const { return edgeFrom(ringEdges[ringStart[t] + i]); }
+    float vx(int t, int i) const { return verts[2 * ringVert(t, i)]; }
+    float vy(int t, int i) const { return verts[2 * ringVert(t, i) + 1]; }
+
+    const uint32_t* neighbors(int t, int &count) const {
+        count = (int)(adjStart[t+1] - adjStart[t]);
+        return adjList.ptr + adjStart[t];
+    }
+
+    bool isAdjacent(int a, int b) const {
+        const uint32_t* row = adjList.ptr + adjStart[a];
+        return std::binary_search(row, adjList.ptr + adjStart[a+1], (uint32_t)b);
+    }
+
+    std::string territoryName(int t) const {
+        return std::string(names.ptr + nameStart[t], nameStart[t+1] - nameStart[t]);
+    }
+
+    size_t imageBytes() const { return imageLen; }
+
+private:
+    MapData() = default;
+
+    std::vector<unsigned char> owned; // image built in memory
+    void*  mapped = nullptr;          // or mapped from a file
+    size_t mappedLen = 0;
+    const unsigned char* image = nullptr;
+    size_t imageLen = 0;
+
+    bool bind(std::string &err);
+};
+
+#endif
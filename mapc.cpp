@@ -0,0 +1,36 @@
+// mapc.cpp
+// risk_mapc: compiles a text map into a .rmap image the game maps directly,
+// with its distance cache beside it.
+//   risk_mapc maps/world.map maps/world.rmap
+#include <cstdio>
+#include <string>
+#include "distance.h"
+#include "map.h"
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::fprintf(stderr, "usage: %s <in.map> <out.rmap>\n", argv[0]);
+        return 2;
+    }
+    std::string err;
+    std::shared_ptr<const MapData> map = MapData::load(argv[1], err);
+    if (!map) {
+        std::fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+    }
+    if (!map->save(argv[2], err)) {
+        std::fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+    }
+    std::printf("%s: %u territories, %u vertices, %u outline levels, %zu bytes\n",
+                map->name.c_str(), map->numTerrs, map->numVerts, map->numLevels, map->imageBytes());
+    DistanceTable dist;
+    dist.load(*map, argv[2]);
+    if (!dist.fromCache && !dist.saveCache(argv[2], err)) {
+        std::fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+    }
+    std::printf("%s: %s, %zu bytes\n", distCachePath(argv[2]).c_str(),
+                dist.exact() ? "all pairs" : "landmarks", dist.bytes());
+    return 0;
+}
@@ -0,0 +1,292 @@
+// mapfile.cpp
+#include "mapfile.h"
+#include "borders.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+// cursor over a NUL-terminated buffer, one line at a time
+struct Cursor {
+    const char* p;
+    const char* end;
+    int line = 1;
+
+    void skipSpaces() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    }
+    bool atEol() {
+        skipSpaces();
+        return p >= end || *p == '\n' || *p == '#';
+    }
+    void nextLine() {
+        while (p < end && *p != '\n') ++p;
+        if (p < end) ++p;
+        ++line;
+    }
+    bool word(const char* &s, size_t &n) {
+        if (atEol()) return false;
+        s = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '#') ++p;
+        n = (size_t)(p - s);
+        return true;
+    }
+    bool number(float &v) {
+        if (atEol()) return false;
+        char* stop;
+        v = std::strtof(p, &stop);
+        if (stop == p) return false;
+        p = stop;
+        return true;
+    }
+    bool integer(long &v) {
+        if (atEol()) return false;
+        char* stop;
+        v = std::strtol(p, &stop, 10);
+        if (stop == p) return false;
+        p = stop;
+        return true;
+    }
+};
+
+bool is(const char* s, size_t n, const char* kw) {
+    return std::strlen(kw) == n && std::memcmp(s, kw, n) == 0;
+}
+
+} // namespace
+
+bool parseMapText(const char* text, size_t len, const char* fileName, MapSource &src,
+                  std::string &err) {
+    std::string &mapName = src.name;
+    std::vector<TerritorySource> &terrs = src.terrs;
+    std::vector<Continent> &continents = src.continents;
+    terrs.clear();
+    continents.clear();
+    mapName.clear();
+
+    Cursor c{text, text + len};
+    int errLine = 0;
+    auto fail = [&](const std::string &msg) {
+        err = std::string(fileName) + ":" + std::to_string(errLine ? errLine : c.line) + ": " + msg;
+        return false;
+    };
+
+    std::unordered_map<std::string,int> continentIdx, terrIdx;
+    std::vector<int> polyLine, labelSet; // per territory, for later checks
+    // adjacency as (from, to) pairs with the line that declared them
+    std::vector<std::pair<int,int>> adj;
+    std::vector<int> adjLine;
+    // link / unlink records, by name, resolved once every territory is known
+    struct NamedLink { std::string a, b; int line; bool add; };
+    std::vector<NamedLink> links;
+
+    for (; c.p < c.end; c.nextLine()) {
+        const char* kw;
+        size_t kwLen;
+        if (!c.word(kw, kwLen)) continue; // blank or comment
+
+        TerritorySource* cur = terrs.empty() ? nullptr : &terrs.back();
+        bool needTerr = !is(kw, kwLen, "map") && !is(kw, kwLen, "continent") &&
+                        !is(kw, kwLen, "territory") && !is(kw, kwLen, "link") &&
+                        !is(kw, kwLen, "unlink");
+        if (needTerr && !cur) return fail(std::string(kw, kwLen) + " before any territory");
+
+        if (is(kw, kwLen, "map")) {
+            const char* s; size_t n;
+            if (!c.word(s, n)) return fail("map needs a name");
+            mapName.assign(s, n);
+        } else if (is(kw, kwLen, "continent")) {
+            const char* s; size_t n;
+            long bonus;
+            if (!c.word(s, n) || !c.integer(bonus)) return fail("expected: continent <name> <bonus>");
+            std::string name(s, n);
+            if (continentIdx.count(name)) return fail("duplicate continent " + name);
+            continentIdx[name] = (int)continents.size();
+            continents.push_back({name, (int)bonus});
+        } else if (is(kw, kwLen, "territory")) {
+            const char* s; size_t n;
+            const char* cs; size_t cn;
+            float r, g, b;
+            if (!c.word(s, n) || !c.word(cs, cn) || !c.number(r) || !c.number(g) || !c.number(b))
+                return fail("expected: territory <name> <continent> <r> <g> <b>");
+            auto it = continentIdx.find(std::string(cs, cn));
+            if (it == continentIdx.end()) return fail("unknown continent " + std::string(cs, cn));
+            std::string name(s, n);
+            if (terrIdx.count(name)) return fail("duplicate territory " + name);
+            terrIdx[name] = (int)terrs.size();
+            terrs.emplace_back();
+            TerritorySource &t = terrs.back();
+            t.name = name;
+            t.continent = it->second;
+            t.r = r; t.g = g; t.b = b;
+            polyLine.push_back(0);
+            labelSet.push_back(0);
+        } else if (is(kw, kwLen, "label")) {
+            float lon, lat;
+            if (!c.number(lon) || !c.number(lat)) return fail("expected: label <lon> <lat>");
+            cur->labelX = lon / 180.0f;
+            cur->labelY = lat / 90.0f;
+            labelSet.back() = 1;
+        } else if (is(kw, kwLen, "poly")) {
+            if (polyLine.back()) return fail("second poly for " + cur->name);
+            polyLine.back() = c.line;
+            float lon, lat;
+            while (c.number(lon)) {
+                if (!c.number(lat)) return fail("poly has an odd number of coordinates");
+                cur->polyX.push_back(lon / 180.0f);
+                cur->polyY.push_back(lat / 90.0f);
+            }
+            if (!c.atEol()) return fail("bad number in poly");
+            size_t n = cur->polyX.size();
+            if (n < 4) return fail("poly needs at least 3 vertices plus the closing one");
+            if (cur->polyX[0] != cur->polyX[n-1] || cur->polyY[0] != cur->polyY[n-1])
+                return fail("poly is not closed (last vertex must repeat the first)");
+            cur->polyX.pop_back();
+            cur->polyY.pop_back();
+        } else if (is(kw, kwLen, "adj")) {
+            long v;
+            int from = (int)terrs.size() - 1;
+            while (c.integer(v)) {
+                adj.push_back({from, (int)v});
+                adjLine.push_back(c.line);
+            }
+            if (!c.atEol()) return fail("bad index in adj");
+        } else if (is(kw, kwLen, "link") || is(kw, kwLen, "unlink")) {
+            const char* a; size_t an;
+            const char* b; size_t bn;
+            bool add = is(kw, kwLen, "link");
+            if (!c.word(a, an) || !c.word(b, bn))
+                return fail(std::string("expected: ") + (add ? "link" : "unlink") + " <territory> <territory>");
+            links.push_back({std::string(a, an), std::string(b, bn), c.line, add});
+        } else {
+            return fail("unknown record " + std::string(kw, kwLen));
+        }
+
+        if (!c.atEol()) return fail("trailing text");
+    }
+
+    // every territory needs an outline; labels default to the centroid
+    for (size_t i = 0; i < terrs.size(); ++i) {
+        TerritorySource &t = terrs[i];
+        if (!polyLine[i]) {
+            err = std::string(fileName) + ": territory " + t.name + " has no poly";
+            return false;
+        }
+        if (!labelSet[i]) {
+            float sx = 0, sy = 0;
+            for (size_t k = 0; k < t.polyX.size(); ++k) { sx += t.polyX[k]; sy += t.polyY[k]; }
+            t.labelX = sx / t.polyX.size();
+            t.labelY = sy / t.polyY.size();
+        }
+    }
+
+    // indices in range, no self links, no repeats, and every link mirrored
+    int n = (int)terrs.size();
+    for (size_t k = 0; k < adj.size(); ++k) {
+        errLine = adjLine[k];
+        if (adj[k].second < 0 || adj[k].second >= n)
+            return fail("neighbor index " + std::to_string(adj[k].second) + " out of range");
+        if (adj[k].second == adj[k].first) return fail("territory lists itself as a neighbor");
+    }
+    std::vector<std::pair<int,int>> sorted(adj);
+    std::sort(sorted.begin(), sorted.end());
+    auto lineOf = [&](const std::pair<int,int> &e) {
+        return adjLine[std::find(adj.begin(), adj.end(), e) - adj.begin()];
+    };
+    for (size_t k = 1; k < sorted.size(); ++k) {
+        if (sorted[k] == sorted[k-1]) {
+            errLine = lineOf(sorted[k]);
+            return fail("neighbor " + std::to_string(sorted[k].second) + " listed twice");
+        }
+    }
+    for (const std::pair<int,int> &e : sorted) {
+        if (!std::binary_search(sorted.begin(), sorted.end(), std::make_pair(e.second, e.first))) {
+            errLine = lineOf(e);
+            return fail("adjacency not symmetric: " + terrs[e.first].name + " lists " +
+                        terrs[e.second].name + " but not the other way round");
+        }
+    }
+
+    // shared borders, plus adj and link records, minus unlink records
+    std::vector<std::pair<int,int>> pairs;
+    findSharedBorders(src, pairs);
+    for (const std::pair<int,int> &e : adj) {
+        if (e.first < e.second) pairs.push_back(e);
+    }
+    std::vector<std::pair<int,int>> removed;
+    for (const NamedLink &l : links) {
+        errLine = l.line;
+        auto a = terrIdx.find(l.a), b = terrIdx.find(l.b);
+        if (a == terrIdx.end()) return fail("unknown territory " + l.a);
+        if (b == terrIdx.end()) return fail("unknown territory " + l.b);
+        if (a->second == b->second) return fail("territory linked to itself");
+        std::pair<int,int> e(std::min(a->second, b->second), std::max(a->second, b->second));
+        if (l.add) pairs.push_back(e);
+        else removed.push_back(e);
+    }
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    std::sort(removed.begin(), removed.end());
+    for (const std::pair<int,int> &e : pairs) {
+        if (std::binary_search(removed.begin(), removed.end(), e)) continue;
+        terrs[e.first].neighbors.push_back(e.second);
+        terrs[e.second].neighbors.push_back(e.first);
+    }
+    for (TerritorySource &t : terrs) std::sort(t.neighbors.begin(), t.neighbors.end());
+    return true;
+}
+
+bool loadMapText(const char* path, MapSource &src, std::string &err) {
+    FILE* f = std::fopen(path, "rb");
+    if (!f) {
+        err = std::string(path) + ": cannot open";
+        return false;
+    }
+    std::vector<char> buf;
+    char chunk[1 << 16];
+    size_t got;
+    while ((got = std::fread(chunk, 1, sizeof(chunk), f)) > 0) buf.insert(buf.end(), chunk, chunk + got);
+    std::fclose(f);
+    buf.push_back('\0'); // strtof / strtol stop here at the latest
+
+    return parseMapText(buf.data(), buf.size() - 1, path, src, err);
+}
+
+bool saveMapText(const char* path, const MapSource &src, std::string &err) {
+    std::string tmp = std::string(path) + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) {
+        err = std::string(path) + ": cannot write";
+        return false;
+    }
+    std::fprintf(f, "map %s\n", src.name.empty() ? "unnamed" : src.name.c_str());
+    for (const Continent &c : src.continents) std::fprintf(f, "continent %s %d\n", c.name.c_str(), c.bonus);
+    // the format wants a continent on every territory
+    bool orphans = false;
+    for (const TerritorySource &t : src.terrs) orphans |= t.continent < 0;
+    if (orphans) std::fputs("continent none 0\n", f);
+    for (const TerritorySource &t : src.terrs) {
+        const char* cont = t.continent >= 0 ? src.continents[t.continent].name.c_str() : "none";
+        std::fprintf(f, "territory %s %s %.9g %.9g %.9g\n", t.name.c_str(), cont, t.r, t.g, t.b);
+        std::fprintf(f, "label %.9g %.9g\n", t.labelX * 180.0f, t.labelY * 90.0f);
+        std::fputs("poly", f);
+        for (size_t k = 0; k <= t.polyX.size(); ++k) {
+            size_t v = k % t.polyX.size();
+            std::fprintf(f, " %.9g %.9g", t.polyX[v] * 180.0f, t.polyY[v] * 90.0f);
+        }
+        std::fputs("\nadj", f);
+        for (int nb : t.neighbors) std::fprintf(f, " %d", nb);
+        std::fputc('\n', f);
+    }
+    bool ok = !std::ferror(f);
+    ok = (std::fclose(f) == 0) && ok;
+    if (ok) ok = std::rename(tmp.c_str(), path) == 0;
+    if (!ok) {
+        std::remove(tmp.c_str());
+        err = std::string(path) + ": write failed";
+    }
+    return ok;
+}
@@ -0,0 +1,36 @@
+// mapfile.h
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <string>
+#include <vector>
+#include "map.h"
+
+// Text map format, one record per line, '#' starts a comment:
+//
+//   map <name>
+//   continent <name> <bonus>
+//   territory <name> <continent> <r> <g> <b>
+//   label <lon> <lat>                      (optional, defaults to the centroid)
+//   poly <lon> <lat> ... <lon0> <lat0>      (closed: repeats the first vertex)
+//   adj <index> <index> ...                 (0-based territory indices)
+//   link <territory> <territory>            (neighbors without a shared border)
+//   unlink <territory> <territory>          (border that should not connect)
+//
+// Continent and territory names are unique. label/poly/adj apply to the
+// territory above them; link/unlink name territories anywhere in the file. Territories whose polygons share a
+// stretch of border are neighbors automatically, so adj and link are
+// only needed for sea lanes and other links the outlines don't show.
+// Territories come back in file order with lon/lat converted to world
+// units; MapData::compile turns the result into a map image.
+// On failure err reads "<file>:<line>: <problem>".
+bool loadMapText(const char* path, MapSource &src, std::string &err);
+
+bool parseMapText(const char* text, size_t len, const char* fileName, MapSource &src,
+                  std::string &err);
+
+// writes src in the format above; vertices shared by two territories
+// still match bit for bit when the file is read back
+bool saveMapText(const char* path, const MapSource &src, std::string &err);
+
+#endif
@@ -0,0 +1,56 @@
+// mapgen.cpp
+// risk_mapgen: writes a generated map for scaling tests.
+//   risk_mapgen <preset|territories> <out.map|out.rmap> [seed] [lloyd] [continents]
+// Presets are the benchmark scenes in voronoi.cpp; .rmap output is compiled
+// directly, anything else is written as a text map.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "map.h"
+#include "mapfile.h"
+#include "voronoi.h"
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: %s <preset|territories> <out.map|out.rmap> [seed] [lloyd] [continents]\n",
+                     argv[0]);
+        std::fprintf(stderr, "presets:");
+        for (int i = 0; i < kNumMapGenPresets; ++i) {
+            std::fprintf(stderr, " %s(%d)", kMapGenPresets[i].name, kMapGenPresets[i].territories);
+        }
+        std::fprintf(stderr, "\n");
+        return 2;
+    }
+
+    MapGenOptions opt;
+    if (const MapGenPreset* p = findMapGenPreset(argv[1])) {
+        opt.territories = p->territories;
+        opt.lloydIterations = p->lloydIterations;
+    } else {
+        opt.territories = std::atoi(argv[1]);
+    }
+    if (argc > 3) opt.seed = std::strtoull(argv[3], nullptr, 10);
+    if (argc > 4) opt.lloydIterations = std::atoi(argv[4]);
+    if (argc > 5) opt.continents = std::atoi(argv[5]);
+    if (opt.territories < 2 || opt.territories > 4000000) {
+        std::fprintf(stderr, "territories must be a preset or 2..4000000\n");
+        return 2;
+    }
+
+    MapSource src;
+    generateVoronoiMap(opt, src);
+
+    std::string err;
+    std::string out = argv[2];
+    bool binary = out.size() > 5 && out.compare(out.size() - 5, 5, ".rmap") == 0;
+    bool ok = binary ? MapData::compile(src)->save(argv[2], err)
+                     : saveMapText(argv[2], src, err);
+    if (!ok) {
+        std::fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+    }
+    std::printf("%s: %d territories, %d continents\n",
+                src.name.c_str(), (int)src.terrs.size(), (int)src.continents.size());
+    return 0;
+}
@@ -0,0 +1,284 @@
+// net.cpp
+#include "net.h"
+#include "snapshot.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t kHeaderBytes = 5; // length, type
+
+bool splitHostPort(const char* hostPort, std::string &host, std::string &port) {
+    std::string s = hostPort;
+    size_t colon = s.rfind(':');
+    host = colon == std::string::npos ? "127.0.0.1" : s.substr(0, colon);
+    port = colon == std::string::npos ? s : s.substr(colon + 1);
+    return !port.empty();
+}
+
+void tune(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// first address that works, listening or connected
+int openSocket(const char* hostPort, bool listening, std::string &err) {
+    std::string host, port;
+    if (!splitHostPort(hostPort, host, port)) {
+        err = std::string(hostPort) + ": expected host:port";
+        return -1;
+    }
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+    addrinfo* list = nullptr;
+    int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &list);
+    if (rc != 0) {
+        err = std::string(hostPort) + ": " + gai_strerror(rc);
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo* a = list; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) continue;
+        bool ok;
+        if (listening) {
+            int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            ok = bind(fd, a->ai_addr, a->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0;
+        } else {
+            ok = ::connect(fd, a->ai_addr, a->ai_addrlen) == 0;
+        }
+        if (!ok) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(list);
+    if (fd < 0) {
+        err = std::string(hostPort) + (listening ? ": cannot listen" : ": cannot connect");
+        return -1;
+    }
+    tune(fd);
+    return fd;
+}
+
+} // namespace
+
+int netListen(const char* hostPort, std::string &err) {
+    return openSocket(hostPort, true, err);
+}
+
+int netConnect(const char* hostPort, std::string &err) {
+    return openSocket(hostPort, false, err);
+}
+
+// ---------------- NetConn ----------------
+
+bool NetConn::readAvailable() {
+    if (fd < 0) return false;
+    // drop what nextMessage has finished with before growing
+    if (consumed > 0) {
+        in.erase(in.begin(), in.begin() + consumed);
+        consumed = 0;
+    }
+    unsigned char chunk[65536];
+    for (;;) {
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n > 0) {
+            in.insert(in.end(), chunk, chunk + n);
+            continue;
+        }
+        if (n == 0) return false; // closed
+        if (errno == EINTR) continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+bool NetConn::nextMessage(uint8_t &type, const unsigned char* &body, uint32_t &len) {
+    if (in.size() - consumed < kHeaderBytes) return false;
+    const unsigned char* p = in.data() + consumed;
+    uint32_t size;
+    std::memcpy(&size, p, sizeof(size));
+    if (size < 1 || size > kNetMaxMessage) {
+        close(); // not our protocol
+        return false;
+    }
+    if (in.size() - consumed < sizeof(size) + size) return false;
+    type = p[4];
+    body = p + kHeaderBytes;
+    len = size - 1;
+    consumed += sizeof(size) + size;
+    return true;
+}
+
+void NetConn::queue(uint8_t type, const void* body, uint32_t len) {
+    if (fd < 0) return;
+    if (sent == out.size()) {
+        out.clear();
+        sent = 0;
+    }
+    uint32_t size = len + 1;
+    const unsigned char* s = (const unsigned char*)&size;
+    const unsigned char* b = (const unsigned char*)body;
+    out.insert(out.end(), s, s + sizeof(size));
+    out.push_back(type);
+    out.insert(out.end(), b, b + len);
+}
+
+bool NetConn::flush() {
+    if (fd < 0) return false;
+    while (sent < out.size()) {
+        ssize_t n = ::send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+    out.clear();
+    sent = 0;
+    return true;
+}
+
+void NetConn::close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    in.clear();
+    out.clear();
+    consumed = sent = 0;
+}
+
+// ---------------- NetClient ----------------
+
+bool NetClient::connect(const char* hostPort, uint64_t game, uint64_t token, Game &view, std::string &err) {
+    conn.close();
+    conn.fd = netConnect(hostPort, err);
+    if (conn.fd < 0) return false;
+    NetJoin join = {game, token};
+    conn.queue(MSG_JOIN, &join, sizeof(join));
+    if (!conn.flush()) {
+        err = std::string(hostPort) + ": connection lost";
+        conn.close();
+        return false;
+    }
+
+    // the greeting says which seat is ours and which map the game is on,
+    // and the game itself follows
+    const int kTimeoutMs = 5000;
+    bool greeted = false, open = true;
+    for (;;) {
+        uint8_t type;
+        const unsigned char* body;
+        uint32_t len;
+        while (conn.nextMessage(type, body, len)) {
+            if (!greeted) {
+                NetHello hello;
+                if (type == MSG_REJECT) {
+                    err = std::string(hostPort) + ": no such game";
+                    conn.close();
+                    return false;
+                }
+                if (type != MSG_HELLO || len != sizeof(hello)) {
+                    err = std::string(hostPort) + ": not a risk server";
+                    conn.close();
+                    return false;
+                }
+                std::memcpy(&hello, body, sizeof(hello));
+                if (hello.fingerprint != view.map->fingerprint) {
+                    err = std::string(hostPort) + ": the server is on a different map";
+                    conn.close();
+                    return false;
+                }
+                mySeat = hello.seat;
+                myGame = hello.game;
+                myToken = hello.token;
+                greeted = true;
+            } else if (type == MSG_STATE) {
+                if (!readSnapshot(view, body, len, err)) {
+                    err = std::string(hostPort) + ": " + err;
+                    conn.close();
+                    return false;
+                }
+                return true;
+            }
+        }
+        // whatever arrived before a close has been read by now
+        pollfd p = {conn.fd, POLLIN, 0};
+        if (!open || conn.fd < 0 || ::poll(&p, 1, kTimeoutMs) <= 0) {
+            err = std::string(hostPort) + ": no answer from the server";
+            conn.close();
+            return false;
+        }
+        open = conn.readAvailable();
+    }
+}
+
+bool NetClient::post(const Command &cmd) {
+    NetCommand c = {cmd.type, cmd.terr, cmd.armies};
+    conn.queue(MSG_COMMAND, &c, sizeof(c));
+    return conn.flush();
+}
+
+bool NetClient::poll(Game &view) {
+    if (conn.fd < 0) return false;
+    bool open = conn.readAvailable();
+
+    // only the newest state matters
+    const unsigned char* state = nullptr;
+    uint32_t stateLen = 0;
+    uint8_t type;
+    const unsigned char* body;
+    uint32_t len;
+    while (conn.nextMessage(type, body, len)) {
+        if (type == MSG_STATE) {
+            state = body;
+            stateLen = len;
+        }
+    }
+    bool changed = state && conn.fd >= 0 && show(view, state, stateLen);
+    if (!open || conn.fd < 0) {
+        std::fprintf(stderr, "WARNING: lost the server\n");
+        conn.close();
+    }
+    return changed;
+}
+
+bool NetClient::show(Game &view, const unsigned char* state, uint32_t len) {
+    // readSnapshot clears animations; keep running ones and start new ones
+    std::vector<Territory> before = view.terrs;
+    bool placing = view.phase == PHASE_REINFORCE;
+    std::string err;
+    if (!readSnapshot(view, state, len, err)) {
+        std::fprintf(stderr, "WARNING: bad state from the server: %s\n", err.c_str());
+        return false;
+    }
+    for (size_t i = 0; i < view.terrs.size(); ++i) {
+        Territory &t = view.terrs[i];
+        const Territory &old = before[i];
+        t.capturing = old.capturing;
+        t.animT = old.animT;
+        t.reinforcing = old.reinforcing;
+        t.reinfT = old.reinfT;
+        if (t.owner != old.owner) {
+            t.capturing = true;
+            t.animT = 0.0f;
+        } else if (placing && t.armies > old.armies) {
+            t.reinforcing = true;
+            t.reinfT = 0.0f;
+        }
+    }
+    return true;
+}
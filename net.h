@@ -0,0 +1,107 @@
+// net.h
+#ifndef NET_H
+#define NET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "game.h"
+
+// Wire format between risk_server and its clients: each message is a
+// uint32 length (of what follows, little-endian like everything else),
+// a type byte, then the body. A client opens with JOIN and waits for
+// HELLO.
+enum NetMsg : uint8_t {
+    MSG_HELLO = 1,   // server: NetHello
+    MSG_STATE = 2,   // server: the whole game as a snapshot, after every change
+    MSG_COMMAND = 3, // client: int32 type, terr, armies; clicks are resolved by the server
+    MSG_REJECT = 4,  // server: the last command was out of turn or broke the rules,
+                     // or the game joined does not exist (or, for an open
+                     // seat, was deserted on the way)
+    MSG_JOIN = 5     // client: NetJoin
+};
+
+const uint32_t kNetMaxMessage = 16u << 20;
+
+struct NetCommand {
+    int32_t type;
+    int32_t terr;
+    int32_t armies;
+};
+
+struct NetJoin {
+    uint64_t game;         // 0 for the next open seat anywhere
+    uint64_t token;        // a seat's token from an earlier HELLO, or 0
+};
+
+// A seat goes to the first connection without a token that finds it
+// free, which is sent the seat's token; after that only a connection
+// holding the token gets the seat back, and anyone else watches.
+struct NetHello {
+    int32_t  seat;         // 0, 1, or -1 watching
+    uint32_t pad;
+    uint64_t fingerprint;  // of the server's map
+    uint64_t game;         // for joining again, or watching
+    uint64_t token;        // the seat's, for joining again; 0 watching
+};
+
+// One non-blocking socket with its buffers. Reads take whatever the
+// socket has; sends queue and go out as the socket allows.
+class NetConn {
+public:
+    int fd = -1;
+
+    // false once the peer has gone or sent something malformed
+    bool readAvailable();
+    // the next whole message, if one has arrived; body stays valid until
+    // the next readAvailable
+    bool nextMessage(uint8_t &type, const unsigned char* &body, uint32_t &len);
+
+    void queue(uint8_t type, const void* body, uint32_t len);
+    bool flush();              // false on a dead socket
+    size_t backlog() const { return out.size() - sent; } // queued, not sent
+    void close();
+
+private:
+    std::vector<unsigned char> in, out;
+    size_t consumed = 0;       // of in, by nextMessage
+    size_t sent = 0;           // of out
+};
+
+// host:port, or just a port on this machine; all non-blocking, no delay
+int netListen(const char* hostPort, std::string &err);
+int netConnect(const char* hostPort, std::string &err);
+
+// The game as a server holds it, for the render thread; stands in for
+// GameThread when playing over the network.
+class NetClient {
+public:
+    ~NetClient() { conn.close(); }
+
+    // joins game (0: the next open seat), back into the seat token names
+    // if it is free, and loads it into view, which must already be on the
+    // server's map
+    bool connect(const char* hostPort, uint64_t game, uint64_t token, Game &view, std::string &err);
+
+    int seat() const { return mySeat; }
+    uint64_t gameId() const { return myGame; }
+    uint64_t token() const { return myToken; }
+    bool connected() const { return conn.fd >= 0; }
+
+    bool post(const Command &cmd);
+
+    // newest state into view, starting capture / reinforce animations;
+    // false if nothing changed
+    bool poll(Game &view);
+
+private:
+    NetConn conn;
+    int mySeat = -1;
+    uint64_t myGame = 0;
+    uint64_t myToken = 0;
+
+    bool show(Game &view, const unsigned char* state, uint32_t len);
+};
+
+#endif
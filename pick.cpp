@@ -0,0 +1,222 @@
+// pick.cpp
+#include "pick.h"
+#include <algorithm>
+#include <cmath>
+
+void buildGridArrays(const std::vector<float> &bounds, GridMeta &meta,
+                     std::vector<uint32_t> &cellStart, std::vector<uint32_t> &items) {
+    size_t n = bounds.size() / 4;
+    meta.x0 = meta.y0 = 0.0f;
+    meta.invCellW = meta.invCellH = 1.0f;
+    meta.nx = meta.ny = 0;
+    cellStart.assign(1, 0);
+    items.clear();
+    if (n == 0) return;
+
+    float minX = bounds[0], minY = bounds[1];
+    float maxX = bounds[2], maxY = bounds[3];
+    double sumW = 0, sumH = 0;
+    for (size_t t = 0; t < n; ++t) {
+        const float* b = &bounds[4 * t];
+        minX = std::min(minX, b[0]); maxX = std::max(maxX, b[2]);
+        minY = std::min(minY, b[1]); maxY = std::max(maxY, b[3]);
+        sumW += b[2] - b[0];
+        sumH += b[3] - b[1];
+    }
+
+    // cells about the size of an average territory keep candidate lists short
+    float spanX = std::max(maxX - minX, 1e-6f);
+    float spanY = std::max(maxY - minY, 1e-6f);
+    float cellW = std::max((float)(sumW / n), spanX / 4096.0f);
+    float cellH = std::max((float)(sumH / n), spanY / 4096.0f);
+    int nx = std::max(1, std::min(4096, (int)std::ceil(spanX / cellW)));
+    int ny = std::max(1, std::min(4096, (int)std::ceil(spanY / cellH)));
+    meta.x0 = minX;
+    meta.y0 = minY;
+    meta.invCellW = nx / spanX;
+    meta.invCellH = ny / spanY;
+    meta.nx = (uint32_t)nx;
+    meta.ny = (uint32_t)ny;
+
+    auto cellRange = [&](size_t t, int &cx0, int &cy0, int &cx1, int &cy1) {
+        const float* b = &bounds[4 * t];
+        cx0 = std::max(0, std::min(nx-1, (int)((b[0] - meta.x0) * meta.invCellW)));
+        cx1 = std::max(0, std::min(nx-1, (int)((b[2] - meta.x0) * meta.invCellW)));
+        cy0 = std::max(0, std::min(ny-1, (int)((b[1] - meta.y0) * meta.invCellH)));
+        cy1 = std::max(0, std::min(ny-1, (int)((b[3] - meta.y0) * meta.invCellH)));
+    };
+
+    // count, prefix-sum, fill: two passes, no per-cell vectors
+    cellStart.assign((size_t)nx * ny + 1, 0);
+    for (size_t t = 0; t < n; ++t) {
+        int cx0, cy0, cx1, cy1;
+        cellRange(t, cx0, cy0, cx1, cy1);
+        for (int cy = cy0; cy <= cy1; ++cy)
+            for (int cx = cx0; cx <= cx1; ++cx) cellStart[(size_t)cy * nx + cx + 1]++;
+    }
+    for (size_t c = 1; c < cellStart.size(); ++c) cellStart[c] += cellStart[c-1];
+
+    items.resize(cellStart.back());
+    std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+    for (uint32_t i = 0; i < (uint32_t)n; ++i) {
+        int cx0, cy0, cx1, cy1;
+        cellRange(i, cx0, cy0, cx1, cy1);
+        for (int cy = cy0; cy <= cy1; ++cy)
+            for (int cx = cx0; cx <= cx1; ++cx) items[fill[(size_t)cy * nx + cx]++] = i;
+    }
+}
+
+void SpatialGrid::build(const MapData &m) {
+    map = &m;
+    edgeSoA.build(m);
+}
+
+const uint32_t* SpatialGrid::cell(float x, float y, int &count) const {
+    count = 0;
+    const GridMeta &g = map->grid;
+    if (g.nx == 0) return nullptr;
+    float fx = (x - g.x0) * g.invCellW;
+    float fy = (y - g.y0) * g.invCellH;
+    if (!(fx >= 0.0f && fy >= 0.0f && fx < (float)g.nx && fy < (float)g.ny)) return nullptr;
+    size_t c = (size_t)(int)fy * g.nx + (int)fx;
+    count = (int)(map->gridCells[c+1] - map->gridCells[c]);
+    return map->gridItems.ptr + map->gridCells[c];
+}
+
+int SpatialGrid::pick(float x, float y) const {
+    int count;
+    const uint32_t* cand = cell(x, y, count);
+    for (int k = 0; k < count; ++k) {
+        const float* b = &map->bounds[4 * cand[k]];
+        if (x < b[0] || x > b[2] || y < b[1] || y > b[3]) continue;
+        if (edgeSoA.contains((int)cand[k], x, y)) return (int)cand[k];
+    }
+    return -1;
+}
+
+bool IdRaster::stableRect(float x, float y, int maxCells,
+                          float &x0, float &y0, float &x1, float &y1) const {
+    int32_t id = lookup(x, y);
+    if (id == kBorder) return false;
+    int cx = (int)((x + 1.0f) * 0.5f * (float)w);
+    int cy = (int)((y + 1.0f) * 0.5f * (float)h);
+
+    // cells [lx, hx] x [ly, hy], grown a side at a time while it stays one id
+    int lx = cx, hx = cx, ly = cy, hy = cy;
+    auto rowSame = [&](int y, int a, int b) {
+        const int32_t* r = &ids[(size_t)y * w];
+        for (int i = a; i <= b; ++i) if (r[i] != id) return false;
+        return true;
+    };
+    auto colSame = [&](int x, int a, int b) {
+        for (int i = a; i <= b; ++i) if (ids[(size_t)i * w + x] != id) return false;
+        return true;
+    };
+    bool grew = true;
+    while (grew) {
+        grew = false;
+        if (hx - lx + 1 < maxCells) {
+            if (lx > 0 && colSame(lx - 1, ly, hy)) { --lx; grew = true; }
+            if (hx < w - 1 && hx - lx + 1 < maxCells && colSame(hx + 1, ly, hy)) { ++hx; grew = true; }
+        }
+        if (hy - ly + 1 < maxCells) {
+            if (ly > 0 && rowSame(ly - 1, lx, hx)) { --ly; grew = true; }
+            if (hy < h - 1 && hy - ly + 1 < maxCells && rowSame(hy + 1, lx, hx)) { ++hy; grew = true; }
+        }
+    }
+    x0 = (float)lx       / w * 2.0f - 1.0f;
+    x1 = (float)(hx + 1) / w * 2.0f - 1.0f;
+    y0 = (float)ly       / h * 2.0f - 1.0f;
+    y1 = (float)(hy + 1) / h * 2.0f - 1.0f;
+    return true;
+}
+
+// mark every cell the segment passes through (Amanatides-Woo traversal)
+void IdRaster::markSegment(float ax, float ay, float bx, float by) {
+    // to cell units
+    float fx0 = (ax + 1.0f) * 0.5f * w, fy0 = (ay + 1.0f) * 0.5f * h;
+    float fx1 = (bx + 1.0f) * 0.5f * w, fy1 = (by + 1.0f) * 0.5f * h;
+
+    // clip to the raster with Liang-Barsky so the walk stays inside
+    float t0 = 0.0f, t1 = 1.0f;
+    float dx = fx1 - fx0, dy = fy1 - fy0;
+    const float p[4] = {-dx, dx, -dy, dy};
+    const float q[4] = {fx0, (float)w - fx0, fy0, (float)h - fy0};
+    for (int k = 0; k < 4; ++k) {
+        if (p[k] == 0.0f) {
+            if (q[k] < 0.0f) return;
+            continue;
+        }
+        float r = q[k] / p[k];
+        if (p[k] < 0.0f) t0 = std::max(t0, r);
+        else             t1 = std::min(t1, r);
+        if (t0 > t1) return;
+    }
+    float sx = fx0 + t0 * dx, sy = fy0 + t0 * dy;
+    float ex = fx0 + t1 * dx, ey = fy0 + t1 * dy;
+
+    int cx = std::max(0, std::min(w-1, (int)sx));
+    int cy = std::max(0, std::min(h-1, (int)sy));
+    int endX = std::max(0, std::min(w-1, (int)ex));
+    int endY = std::max(0, std::min(h-1, (int)ey));
+    int stepX = dx > 0 ? 1 : -1;
+    int stepY = dy > 0 ? 1 : -1;
+    float tDeltaX = dx != 0.0f ? std::fabs(1.0f / dx) : INFINITY;
+    float tDeltaY = dy != 0.0f ? std::fabs(1.0f / dy) : INFINITY;
+    float tMaxX = dx != 0.0f ? ((dx > 0 ? (cx + 1) - sx : sx - cx) * tDeltaX) : INFINITY;
+    float tMaxY = dy != 0.0f ? ((dy > 0 ? (cy + 1) - sy : sy - cy) * tDeltaY) : INFINITY;
+
+    // bounded by the Manhattan distance, in case rounding overshoots the end
+    int steps = std::abs(endX - cx) + std::abs(endY - cy) + 2;
+    for (;;) {
+        ids[(size_t)cy * w + cx] = kBorder;
+        if ((cx == endX && cy == endY) || --steps < 0) break;
+        if (tMaxX < tMaxY) { cx += stepX; tMaxX += tDeltaX; }
+        else               { cy += stepY; tMaxY += tDeltaY; }
+        if (cx < 0 || cx >= w || cy < 0 || cy >= h) break;
+    }
+}
+
+void IdRaster::build(const MapData &map, const SpatialGrid &grid, int width, int height) {
+    w = std::max(1, width);
+    h = std::max(1, height);
+    ids.assign((size_t)w * h, -1);
+
+    // any cell an outline passes through needs the exact test
+    // (shared borders are one edge, so each is walked once)
+    for (uint32_t k = map.edgeStart[0]; k < map.edgeStart[1]; ++k) {
+        const MapEdge &e = map.edges[k];
+        markSegment(map.verts[2*e.v0], map.verts[2*e.v0+1], map.verts[2*e.v1], map.verts[2*e.v1+1]);
+    }
+
+    // the rest lie wholly inside the same territories, so the centre decides.
+    // Territories go in index order and only claim cells still empty, which
+    // keeps the lowest-index-wins rule of SpatialGrid::pick.
+    const EdgeSoA &edges = grid.edges();
+    std::vector<float> xs, ys;
+    std::vector<uint32_t> cells;
+    std::vector<uint8_t> inside;
+    for (int i = 0; i < (int)map.numTerrs; ++i) {
+        const float* b = &map.bounds[4 * i];
+        int cx0 = std::max(0,   (int)std::floor((b[0] + 1.0f) * 0.5f * w));
+        int cx1 = std::min(w-1, (int)std::floor((b[2] + 1.0f) * 0.5f * w));
+        int cy0 = std::max(0,   (int)std::floor((b[1] + 1.0f) * 0.5f * h));
+        int cy1 = std::min(h-1, (int)std::floor((b[3] + 1.0f) * 0.5f * h));
+
+        xs.clear(); ys.clear(); cells.clear();
+        for (int y = cy0; y <= cy1; ++y) {
+            for (int x = cx0; x <= cx1; ++x) {
+                uint32_t c = (uint32_t)y * w + x;
+                if (ids[c] != -1) continue;
+                cells.push_back(c);
+                xs.push_back(((x + 0.5f) / w) * 2.0f - 1.0f);
+                ys.push_back(((y + 0.5f) / h) * 2.0f - 1.0f);
+            }
+        }
+        inside.resize(cells.size());
+        edges.containsBatch(i, xs.data(), ys.data(), (int)cells.size(), inside.data());
+        for (size_t k = 0; k < cells.size(); ++k) {
+            if (inside[k]) ids[cells[k]] = i;
+        }
+    }
+}
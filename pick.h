@@ -0,0 +1,72 @@
+// pick.h
+#ifndef PICK_H
+#define PICK_H
+
+#include <cstdint>
+#include <vector>
+#include "map.h"
+#include "pip.h"
+
+// Uniform grid over territory bounding boxes (minX,minY,maxX,maxY per
+// territory), built by MapData::compile. Each cell lists (in territory
+// order) the territories whose box touches it, so a pick only runs the
+// polygon test on the few candidates under the cursor.
+void buildGridArrays(const std::vector<float> &bounds, GridMeta &meta,
+                     std::vector<uint32_t> &cellStart, std::vector<uint32_t> &items);
+
+// picking over the grid stored in a MapData
+class SpatialGrid {
+public:
+    void build(const MapData &map);
+
+    // territory under (x,y) in world space, lowest index wins; -1 if none
+    int pick(float x, float y) const;
+
+    // candidates for the cell containing (x,y); count 0 outside the grid
+    const uint32_t* cell(float x, float y, int &count) const;
+
+    const EdgeSoA& edges() const { return edgeSoA; }
+
+private:
+    const MapData* map = nullptr;
+    EdgeSoA edgeSoA;
+};
+
+// Territory id per cell over the atlas quad [-1,1]x[-1,1], built once at
+// map load. Cells crossed by any outline are marked kBorder and resolved
+// with an exact test; every other cell is a single array read.
+class IdRaster {
+public:
+    static const int32_t kBorder = -2;
+
+    // w x h is usually the atlas size in texels
+    void build(const MapData &map, const SpatialGrid &grid, int w, int h);
+
+    // territory id, -1 for none, or kBorder; kBorder outside the raster too
+    int32_t lookup(float x, float y) const {
+        float fx = (x + 1.0f) * 0.5f * (float)w;
+        float fy = (y + 1.0f) * 0.5f * (float)h;
+        if (!(fx >= 0.0f && fy >= 0.0f && fx < (float)w && fy < (float)h)) return kBorder;
+        return ids[(size_t)(int)fy * w + (int)fx];
+    }
+
+    int pick(const SpatialGrid &grid, float x, float y) const {
+        int32_t id = lookup(x, y);
+        return id != kBorder ? id : grid.pick(x, y);
+    }
+
+    // world rectangle around (x,y), up to maxCells wide and high, where
+    // every point picks the same territory: the cell under (x,y) grown
+    // while whole rows and columns of non-border cells agree. False on
+    // border cells and outside the raster.
+    bool stableRect(float x, float y, int maxCells,
+                    float &x0, float &y0, float &x1, float &y1) const;
+
+private:
+    int w = 0, h = 0;
+    std::vector<int32_t> ids;
+
+    void markSegment(float ax, float ay, float bx, float by);
+};
+
+#endif
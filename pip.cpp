@@ -0,0 +1,181 @@
+// pip.cpp
+#include "pip.h"
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PIP_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const int kPad = 16;
+
+typedef bool (*ContainsFn)(const float* y0, const float* y1, const float* x0, const float* sl,
+                           int n, float x, float y);
+typedef void (*BatchFn)(const float* y0, const float* y1, const float* x0, const float* sl,
+                        int n, const float* xs, const float* ys, int count, uint8_t* out);
+
+// an edge crosses the ray to +x when it straddles y and meets it right of x
+bool containsScalar(const float* y0, const float* y1, const float* x0, const float* sl,
+                    int n, float x, float y) {
+    bool inside = false;
+    for (int e = 0; e < n; ++e) {
+        if (((y0[e] > y) != (y1[e] > y)) && (x < x0[e] + sl[e] * (y - y0[e]))) inside = !inside;
+    }
+    return inside;
+}
+
+void batchScalar(const float* y0, const float* y1, const float* x0, const float* sl,
+                 int n, const float* xs, const float* ys, int count, uint8_t* out) {
+    for (int i = 0; i < count; ++i) out[i] = containsScalar(y0, y1, x0, sl, n, xs[i], ys[i]);
+}
+
+#ifdef PIP_X86
+__attribute__((target("avx2")))
+bool containsAvx2(const float* y0, const float* y1, const float* x0, const float* sl,
+                  int n, float x, float y) {
+    const __m256 vx = _mm256_set1_ps(x);
+    const __m256 vy = _mm256_set1_ps(y);
+    __m256 acc = _mm256_setzero_ps();
+    for (int e = 0; e < n; e += 8) {
+        __m256 a  = _mm256_loadu_ps(y0 + e);
+        __m256 st = _mm256_xor_ps(_mm256_cmp_ps(a, vy, _CMP_GT_OQ),
+                                  _mm256_cmp_ps(_mm256_loadu_ps(y1 + e), vy, _CMP_GT_OQ));
+        __m256 xc = _mm256_add_ps(_mm256_loadu_ps(x0 + e),
+                                  _mm256_mul_ps(_mm256_loadu_ps(sl + e), _mm256_sub_ps(vy, a)));
+        acc = _mm256_xor_ps(acc, _mm256_and_ps(st, _mm256_cmp_ps(vx, xc, _CMP_LT_OQ)));
+    }
+    // each lane holds the parity of its own edges
+    return __builtin_popcount(_mm256_movemask_ps(acc)) & 1;
+}
+
+__attribute__((target("avx2")))
+void batchAvx2(const float* y0, const float* y1, const float* x0, const float* sl,
+               int n, const float* xs, const float* ys, int count, uint8_t* out) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 px = _mm256_loadu_ps(xs + i);
+        const __m256 py = _mm256_loadu_ps(ys + i);
+        __m256 acc = _mm256_setzero_ps();
+        for (int e = 0; e < n; ++e) {
+            __m256 a  = _mm256_set1_ps(y0[e]);
+            __m256 st = _mm256_xor_ps(_mm256_cmp_ps(a, py, _CMP_GT_OQ),
+                                      _mm256_cmp_ps(_mm256_set1_ps(y1[e]), py, _CMP_GT_OQ));
+            __m256 xc = _mm256_add_ps(_mm256_set1_ps(x0[e]),
+                                      _mm256_mul_ps(_mm256_set1_ps(sl[e]), _mm256_sub_ps(py, a)));
+            acc = _mm256_xor_ps(acc, _mm256_and_ps(st, _mm256_cmp_ps(px, xc, _CMP_LT_OQ)));
+        }
+        int m = _mm256_movemask_ps(acc);
+        for (int k = 0; k < 8; ++k) out[i+k] = (uint8_t)((m >> k) & 1);
+    }
+    batchScalar(y0, y1, x0, sl, n, xs + i, ys + i, count - i, out + i);
+}
+
+__attribute__((target("avx512f")))
+bool containsAvx512(const float* y0, const float* y1, const float* x0, const float* sl,
+                    int n, float x, float y) {
+    const __m512 vx = _mm512_set1_ps(x);
+    const __m512 vy = _mm512_set1_ps(y);
+    __mmask16 acc = 0;
+    for (int e = 0; e < n; e += 16) {
+        __m512 a = _mm512_loadu_ps(y0 + e);
+        __mmask16 st = _mm512_cmp_ps_mask(a, vy, _CMP_GT_OQ) ^
+                       _mm512_cmp_ps_mask(_mm512_loadu_ps(y1 + e), vy, _CMP_GT_OQ);
+        __m512 xc = _mm512_add_ps(_mm512_loadu_ps(x0 + e),
+                                  _mm512_mul_ps(_mm512_loadu_ps(sl + e), _mm512_sub_ps(vy, a)));
+        acc ^= st & _mm512_cmp_ps_mask(vx, xc, _CMP_LT_OQ);
+    }
+    return __builtin_popcount(acc) & 1;
+}
+
+__attribute__((target("avx512f")))
+void batchAvx512(const float* y0, const float* y1, const float* x0, const float* sl,
+                 int n, const float* xs, const float* ys, int count, uint8_t* out) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m512 px = _mm512_loadu_ps(xs + i);
+        const __m512 py = _mm512_loadu_ps(ys + i);
+        __mmask16 acc = 0;
+        for (int e = 0; e < n; ++e) {
+            __m512 a = _mm512_set1_ps(y0[e]);
+            __mmask16 st = _mm512_cmp_ps_mask(a, py, _CMP_GT_OQ) ^
+                           _mm512_cmp_ps_mask(_mm512_set1_ps(y1[e]), py, _CMP_GT_OQ);
+            __m512 xc = _mm512_add_ps(_mm512_set1_ps(x0[e]),
+                                      _mm512_mul_ps(_mm512_set1_ps(sl[e]), _mm512_sub_ps(py, a)));
+            acc ^= st & _mm512_cmp_ps_mask(px, xc, _CMP_LT_OQ);
+        }
+        for (int k = 0; k < 16; ++k) out[i+k] = (uint8_t)((acc >> k) & 1);
+    }
+    batchAvx2(y0, y1, x0, sl, n, xs + i, ys + i, count - i, out + i);
+}
+#endif
+
+struct Kernels {
+    ContainsFn  contains;
+    BatchFn     batch;
+    const char* name;
+};
+
+Kernels selectKernels() {
+#ifdef PIP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return {containsAvx512, batchAvx512, "avx512"};
+    if (__builtin_cpu_supports("avx2"))    return {containsAvx2,   batchAvx2,   "avx2"};
+#endif
+    return {containsScalar, batchScalar, "scalar"};
+}
+
+const Kernels& kernels() {
+    static const Kernels k = selectKernels();
+    return k;
+}
+
+} // namespace
+
+void EdgeSoA::build(const MapData &map) {
+    size_t numTerrs = map.numTerrs;
+    start.assign(numTerrs + 1, 0);
+    count.assign(numTerrs, 0);
+    size_t total = 0;
+    for (size_t i = 0; i < numTerrs; ++i) {
+        start[i] = (uint32_t)total;
+        count[i] = (uint32_t)map.ringSize((int)i);
+        total += (count[i] + kPad - 1) / kPad * kPad;
+    }
+    start[numTerrs] = (uint32_t)total;
+
+    // padding edges sit at +inf, so they never straddle a finite y
+    y0.assign(total, INFINITY);
+    y1.assign(total, INFINITY);
+    x0.assign(total, 0.0f);
+    slope.assign(total, 0.0f);
+
+    for (size_t i = 0; i < numTerrs; ++i) {
+        int t = (int)i, n = (int)count[i];
+        for (int k = 0, j = n - 1; k < n; j = k++) {
+            size_t e = start[i] + k;
+            y0[e] = map.vy(t, j);
+            y1[e] = map.vy(t, k);
+            x0[e] = map.vx(t, j);
+            float dy = map.vy(t, k) - map.vy(t, j);
+            slope[e] = dy != 0.0f ? (map.vx(t, k) - map.vx(t, j)) / dy : 0.0f;
+        }
+    }
+}
+
+bool EdgeSoA::contains(int terrIdx, float x, float y) const {
+    size_t s = start[terrIdx];
+    int n = (int)(start[terrIdx+1] - s);
+    return kernels().contains(y0.data() + s, y1.data() + s, x0.data() + s, slope.data() + s, n, x, y);
+}
+
+void EdgeSoA::containsBatch(int terrIdx, const float* xs, const float* ys, int n, uint8_t* out) const {
+    size_t s = start[terrIdx];
+    kernels().batch(y0.data() + s, y1.data() + s, x0.data() + s, slope.data() + s,
+                    (int)count[terrIdx], xs, ys, n, out);
+}
+
+const char* EdgeSoA::kernelName() {
+    return kernels().name;
+}
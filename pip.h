@@ -0,0 +1,32 @@
+// pip.h
+#ifndef PIP_H
+#define PIP_H
+
+#include <cstdint>
+#include <vector>
+#include "map.h"
+
+// Territory edges as contiguous structure-of-arrays with the slope
+// precomputed, each polygon padded to a multiple of 16 edges so the
+// crossing-number kernels run 16 (AVX-512), 8 (AVX2) or 1 edge at a time
+// with no tail. The widest kernel the CPU supports is picked at startup.
+class EdgeSoA {
+public:
+    void build(const MapData &map);
+
+    // even-odd test of one point against one territory
+    bool contains(int terrIdx, float x, float y) const;
+
+    // many points against one territory; out[i] = 1 when inside
+    void containsBatch(int terrIdx, const float* xs, const float* ys, int count, uint8_t* out) const;
+
+    static const char* kernelName();
+
+private:
+    // edge e runs from (x0[e], y0[e]) to a point at height y1[e]
+    std::vector<float> y0, y1, x0, slope;
+    std::vector<uint32_t> start; // per territory + 1, padded offsets
+    std::vector<uint32_t> count; // real edges per territory
+};
+
+#endif
@@ -0,0 +1,170 @@
+// regions.cpp
+#include "regions.h"
+#include "game.h"
+#include <algorithm>
+
+int OwnerRegions::newLabel() {
+    if (!freeLabels.empty()) {
+        int l = freeLabels.back();
+        freeLabels.pop_back();
+        return l;
+    }
+    size.push_back(0);
+    return (int)size.size() - 1;
+}
+
+void OwnerRegions::dropLabel(int l) {
+    size[l] = 0;
+    freeLabels.push_back(l);
+}
+
+void OwnerRegions::build(const MapData &map, const std::vector<Territory> &terrs) {
+    int n = (int)terrs.size();
+    label.assign(n, -1);
+    size.clear();
+    freeLabels.clear();
+    markEpoch.assign(n, 0);
+    markSearch.assign(n, -1);
+    epoch = 0;
+    for (int s = 0; s < n; ++s) {
+        if (label[s] >= 0) continue;
+        int l = newLabel();
+        label[s] = l;
+        queue.assign(1, s);
+        for (size_t h = 0; h < queue.size(); ++h) {
+            int u = queue[h];
+            for (uint32_t k = map.adjStart[u]; k < map.adjStart[u+1]; ++k) {
+                int v = (int)map.adjList[k];
+                if (label[v] >= 0 || terrs[v].owner != terrs[s].owner) continue;
+                label[v] = l;
+                queue.push_back(v);
+            }
+        }
+        size[l] = (int32_t)queue.size();
+    }
+}
+
+// every territory connected to from through oldLabel moves to newLabel
+void OwnerRegions::relabel(const MapData &map, int from, int oldLabel, int newLabel) {
+    label[from] = newLabel;
+    queue.assign(1, from);
+    for (size_t h = 0; h < queue.size(); ++h) {
+        int u = queue[h];
+        for (uint32_t k = map.adjStart[u]; k < map.adjStart[u+1]; ++k) {
+            int v = (int)map.adjList[k];
+            if (label[v] != oldLabel) continue;
+            label[v] = newLabel;
+            queue.push_back(v);
+        }
+    }
+}
+
+void OwnerRegions::changeOwner(const MapData &map, const std::vector<Territory> &terrs,
+                               int t, int oldOwner) {
+    int newOwner = terrs[t].owner;
+    if (newOwner == oldOwner) return;
+
+    // leave the old region, which may fall apart without t
+    int old = label[t];
+    label[t] = -1;
+    size[old]--;
+    std::vector<int> starts;
+    for (uint32_t k = map.adjStart[t]; k < map.adjStart[t+1]; ++k) {
+        int v = (int)map.adjList[k];
+        if (terrs[v].owner == oldOwner) starts.push_back(v);
+    }
+    if (size[old] == 0) dropLabel(old);
+    else if (starts.size() > 1) split(map, terrs, old, oldOwner, starts);
+
+    // join the new owner's regions around t, keeping the largest label
+    int keep = -1;
+    for (uint32_t k = map.adjStart[t]; k < map.adjStart[t+1]; ++k) {
+        int v = (int)map.adjList[k];
+        if (terrs[v].owner != newOwner) continue;
+        if (keep < 0 || size[label[v]] > size[keep]) keep = label[v];
+    }
+    if (keep < 0) keep = newLabel();
+    for (uint32_t k = map.adjStart[t]; k < map.adjStart[t+1]; ++k) {
+        int v = (int)map.adjList[k];
+        if (terrs[v].owner != newOwner || label[v] == keep) continue;
+        int merged = label[v];
+        size[keep] += size[merged];
+        relabel(map, v, merged, keep);
+        dropLabel(merged);
+    }
+    label[t] = keep;
+    size[keep]++;
+}
+
+// One breadth-first search per start, taking turns one territory at a
+// time. Searches that meet join into a group; a group that runs out of
+// territories first is a piece of its own and gets a fresh label. The
+// last group standing keeps oldLabel, so the work is bounded by the
+// pieces that broke off rather than by the whole region.
+void OwnerRegions::split(const MapData &map, const std::vector<Territory> &terrs,
+                         int oldLabel, int owner, const std::vector<int> &starts) {
+    int k = (int)starts.size();
+    if (++epoch == 0) {
+        std::fill(markEpoch.begin(), markEpoch.end(), 0);
+        epoch = 1;
+    }
+    if ((int)lists.size() < k) lists.resize(k);
+    std::vector<size_t> head(k, 0);
+    std::vector<int> parent(k), left(k, 0);
+    std::vector<char> done(k, 0);
+    auto find = [&parent](int i) {
+        while (parent[i] != i) i = parent[i] = parent[parent[i]];
+        return i;
+    };
+
+    int open = k;
+    for (int i = 0; i < k; ++i) {
+        parent[i] = i;
+        lists[i].clear();
+        int s = starts[i];
+        markEpoch[s] = epoch;
+        markSearch[s] = i;
+        lists[i].push_back(s);
+        left[i] = 1;
+    }
+
+    while (open > 1) {
+        for (int i = 0; i < k && open > 1; ++i) {
+            if (head[i] == lists[i].size()) continue;
+            int u = lists[i][head[i]++];
+            int g = find(i);
+            left[g]--;
+            for (uint32_t e = map.adjStart[u]; e < map.adjStart[u+1]; ++e) {
+                int v = (int)map.adjList[e];
+                if (terrs[v].owner != owner) continue;
+                if (markEpoch[v] != epoch) {
+                    markEpoch[v] = epoch;
+                    markSearch[v] = i;
+                    lists[i].push_back(v);
+                    left[g]++;
+                    continue;
+                }
+                int other = find(markSearch[v]);
+                if (other == g) continue;
+                parent[other] = g;
+                left[g] += left[other];
+                open--;
+            }
+            if (left[g] == 0 && open > 1) {
+                done[g] = 1;
+                open--;
+            }
+        }
+    }
+
+    // pieces that finished get fresh labels; the rest keeps oldLabel
+    std::vector<int> pieceLabel(k, -1);
+    for (int i = 0; i < k; ++i) {
+        int g = find(i);
+        if (!done[g]) continue;
+        if (pieceLabel[g] < 0) pieceLabel[g] = newLabel();
+        for (int v : lists[i]) label[v] = pieceLabel[g];
+        size[pieceLabel[g]] += (int32_t)lists[i].size();
+        size[oldLabel] -= (int32_t)lists[i].size();
+    }
+}
@@ -0,0 +1,49 @@
+// regions.h
+#ifndef REGIONS_H
+#define REGIONS_H
+
+#include <cstdint>
+#include <vector>
+#include "map.h"
+
+struct Territory;
+
+// Connected groups of territories with the same owner, as one label per
+// territory. Labels are unique across owners, so two territories can
+// trade armies over a chain of their owner's land exactly when their
+// labels match. changeOwner keeps the labels current after a capture:
+// joining merges the smaller groups into the largest, and a split relabels
+// only the pieces that broke away, found by searching from every side at
+// once and stopping when one search is left.
+class OwnerRegions {
+public:
+    void build(const MapData &map, const std::vector<Territory> &terrs);
+
+    // t went from oldOwner to the owner terrs now shows
+    void changeOwner(const MapData &map, const std::vector<Territory> &terrs,
+                     int t, int oldOwner);
+
+    bool connected(int a, int b) const { return label[a] == label[b]; }
+    int  regionOf(int t) const { return label[t]; }
+    int  regionSize(int t) const { return size[label[t]]; }
+
+private:
+    std::vector<int32_t> label;      // per territory
+    std::vector<int32_t> size;       // per label, 0 while unused
+    std::vector<int32_t> freeLabels;
+
+    // scratch for relabelling and splits
+    std::vector<uint32_t> markEpoch;
+    std::vector<int32_t>  markSearch;
+    uint32_t epoch = 0;
+    std::vector<std::vector<int>> lists;
+    std::vector<int> queue;
+
+    int  newLabel();
+    void dropLabel(int l);
+    void relabel(const MapData &map, int from, int oldLabel, int newLabel);
+    void split(const MapData &map, const std::vector<Territory> &terrs,
+               int oldLabel, int owner, const std::vector<int> &starts);
+};
+
+#endif
@@ -0,0 +1,139 @@
+// replay.cpp
+#include "replay.h"
+#include <algorithm>
+
+bool Replay::build(const Game &onMap, const Journal &j, std::string &err) {
+    Game g = onMap;
+    if (!replayJournal(g, j, 0, err)) return false;
+
+    numTerrs = (int)g.terrs.size();
+    size_t total = j.records.size();
+    turns.clear();
+    turns.reserve(total + 1);
+    changeStart.assign(1, 0);
+    changes.clear();
+    keyOwner.clear();
+    keyArmies.clear();
+
+    auto record = [&](CommandType action) {
+        TurnState s;
+        s.action             = action;
+        s.currentPlayer      = g.currentPlayer;
+        s.phase              = g.phase;
+        s.reinforcementsLeft = g.reinforcementsLeft;
+        s.winner             = g.winner;
+        s.gameOver           = g.gameOver;
+        s.fortifyDone        = g.fortifyDone;
+        s.attackSel          = g.attackSel;
+        s.fortSel            = g.fortSel;
+        s.rngCount           = g.rngCount;
+        turns.push_back(s);
+        changeStart.push_back((uint32_t)changes.size());
+        if ((turns.size() - 1) % kKeyframeInterval == 0) {
+            for (const Territory &t : g.terrs) {
+                keyOwner.push_back(t.owner);
+                keyArmies.push_back(t.armies);
+            }
+        }
+    };
+    record(CMD_CLICK);
+
+    std::vector<Change> all; // before an undo or redo, which can touch any
+    for (size_t i = 0; i < total; ++i) {
+        const JournalRecord &rec = j.records[i];
+        Command cmd;
+        cmd.type = (CommandType)rec.type;
+        cmd.terr = rec.terr;
+        cmd.armies = rec.armies;
+
+        bool history = cmd.type == CMD_UNDO || cmd.type == CMD_REDO;
+        if (history) {
+            all.resize(numTerrs);
+            for (int t = 0; t < numTerrs; ++t) all[t] = {(uint32_t)t, g.terrs[t].owner, g.terrs[t].armies};
+        }
+
+        // an action only touches its own territory and the selected source
+        int touched[3] = {cmd.terr, g.attackSel.fromTerr, g.fortSel.fromTerr};
+        Change before[3];
+        for (int k = 0; k < 3; ++k) {
+            int t = touched[k];
+            if (t >= 0 && t < numTerrs) before[k] = {(uint32_t)t, g.terrs[t].owner, g.terrs[t].armies};
+        }
+        if (cmd.type == CMD_CLICK || !g.apply(cmd)) {
+            err = "journal record " + std::to_string(i) + " was rejected";
+            return false;
+        }
+        if ((uint32_t)g.rngCount != rec.rngCount) {
+            err = "journal record " + std::to_string(i) + ": dice diverged";
+            return false;
+        }
+        for (int t = 0; history && t < numTerrs; ++t) {
+            const Territory &now = g.terrs[t];
+            if (now.owner != all[t].owner || now.armies != all[t].armies) {
+                changes.push_back({(uint32_t)t, now.owner, now.armies});
+            }
+        }
+        for (int k = 0; k < 3 && !history; ++k) {
+            int t = touched[k];
+            if (t < 0 || t >= numTerrs) continue;
+            if ((k > 0 && t == touched[0]) || (k == 2 && t == touched[1])) continue;
+            const Territory &now = g.terrs[t];
+            if (now.owner == before[k].owner && now.armies == before[k].armies) continue;
+            changes.push_back({(uint32_t)t, now.owner, now.armies});
+        }
+        record(cmd.type);
+    }
+    return true;
+}
+
+void Replay::setTurn(Game &view, size_t pos) const {
+    const TurnState &s = turns[pos];
+    view.currentPlayer      = s.currentPlayer;
+    view.phase              = s.phase;
+    view.reinforcementsLeft = s.reinforcementsLeft;
+    view.winner             = s.winner;
+    view.gameOver           = s.gameOver;
+    view.fortifyDone        = s.fortifyDone;
+    view.attackSel          = s.attackSel;
+    view.fortSel            = s.fortSel;
+    view.rngCount           = s.rngCount;
+}
+
+void Replay::seek(Game &view, size_t pos) const {
+    if (turns.empty()) return;
+    pos = std::min(pos, actions());
+    size_t key = pos / kKeyframeInterval;
+    const int32_t* owner  = &keyOwner[key * numTerrs];
+    const int32_t* armies = &keyArmies[key * numTerrs];
+    for (int t = 0; t < numTerrs; ++t) {
+        Territory &v = view.terrs[t];
+        v.owner = owner[t];
+        v.armies = armies[t];
+        v.capturing = v.reinforcing = false;
+        v.animT = v.reinfT = 0.0f;
+    }
+    for (uint32_t c = changeStart[key * kKeyframeInterval + 1]; c < changeStart[pos + 1]; ++c) {
+        view.terrs[changes[c].terr].owner = changes[c].owner;
+        view.terrs[changes[c].terr].armies = changes[c].armies;
+    }
+    setTurn(view, pos);
+}
+
+void Replay::stepForward(Game &view, size_t pos, bool animate) const {
+    if (pos >= actions()) return;
+    bool placing = turns[pos + 1].action == CMD_PLACE;
+    for (uint32_t c = changeStart[pos + 1]; c < changeStart[pos + 2]; ++c) {
+        Territory &v = view.terrs[changes[c].terr];
+        if (animate && v.owner != changes[c].owner) {
+            v.capturing = true;
+            v.animT = 0.0f;
+        }
+        if (animate && placing) {
+            v.reinforcing = true;
+            v.reinfT = 0.0f;
+        }
+        v.owner = changes[c].owner;
+        v.armies = changes[c].armies;
+    }
+    setTurn(view, pos + 1);
+}
@@ -0,0 +1,64 @@
+// replay.h
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "game.h"
+#include "journal.h"
+
+// Seekable playback of a journal. build() runs the journal once through
+// the rules and keeps, per action, the territories it changed and the
+// turn state after it, plus a full keyframe of owners and armies every
+// kKeyframeInterval actions. A seek copies the nearest keyframe at or
+// before the target and rolls at most that many deltas forward; playing
+// forward only applies the next delta. Views it fills keep their owner
+// regions as they were, since nothing in a replay acts on them.
+class Replay {
+public:
+    static const int kKeyframeInterval = 64;
+
+    // onMap supplies the map; it must be the one the journal was made on
+    bool build(const Game &onMap, const Journal &j, std::string &err);
+
+    size_t actions() const { return turns.empty() ? 0 : turns.size() - 1; }
+
+    // view as it was after the first pos actions, with no animations
+    void seek(Game &view, size_t pos) const;
+
+    // view goes from position pos to pos+1; with animate, captures and
+    // placements flash as they would live
+    void stepForward(Game &view, size_t pos, bool animate) const;
+
+private:
+    struct TurnState {
+        CommandType action; // what led here (CMD_CLICK at position 0)
+        int currentPlayer;
+        Phase phase;
+        int reinforcementsLeft;
+        int winner;
+        bool gameOver;
+        bool fortifyDone;
+        AttackSelection attackSel;
+        FortifySelection fortSel;
+        uint64_t rngCount;
+    };
+    struct Change {
+        uint32_t terr;
+        int32_t  owner;
+        int32_t  armies;
+    };
+
+    int numTerrs = 0;
+    std::vector<TurnState> turns;      // per position
+    std::vector<uint32_t> changeStart; // per position + 1, into changes
+    std::vector<Change>   changes;     // new values, position 0 has none
+    std::vector<int32_t>  keyOwner;    // numTerrs per keyframe
+    std::vector<int32_t>  keyArmies;
+
+    void setTurn(Game &view, size_t pos) const;
+};
+
+#endif
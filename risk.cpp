@@ -4,11 +4,44 @@
 #include <string>
 #include <cmath>
 #include "game.h"
-#include "stb_image.h"
+#include "gamethread.h"
+#include "journal.h"
+#include "lod.h"
+#include "net.h"
+#include "pick.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "softrender.h"
+#include "texcache.h"
 #include <GL/glu.h>
 
 
+// render-side view of the game; the authoritative copy lives on the game
+// thread and reaches this one through poll() in idleCB
 Game game;
+GameThread logic;
+
+// --connect <host:port>: risk_server holds the game instead of logic
+NetClient server;
+bool online = false;
+
+// ESC saves here; resume with --load
+const char* kSavePath = "risk.sav";
+
+// --replay <journal>: the view follows a recording instead of the game thread
+Replay replay;
+bool   replaying = false;
+bool   replayPlaying = false;
+bool   replayScrubbing = false; // dragging on the timeline
+size_t replayPos = 0;
+float  replaySpeed = 1.0f;      // multiplies kReplayRate
+double replayOwed = 0.0;        // actions the clock has run up but not shown
+int    replayTick = 0;          // GLUT_ELAPSED_TIME at the last advance
+const float kReplayRate = 4.0f;       // actions per second at speed 1
+const float kReplayFlashLimit = 8.0f; // faster than this, captures don't flash
+
+// timeline bar, in NDC
+const float kBarX0 = -0.95f, kBarX1 = 0.95f, kBarY0 = -0.93f, kBarY1 = -0.90f;
 
 float camX = 0.0f;   // camera pan
 float camY = 0.0f;
@@ -17,6 +50,22 @@ float camZoom = 1.0f; // 1 = default, >1 zoom in, <1 zoom out
 int windowWidth = 800;
 int windowHeight = 600;
 
+// outlines at several simplification levels, picked by zoom
+PolyLod polyLod;
+
+// click picking: only territories whose box covers the cursor's cell are tested
+SpatialGrid pickGrid;
+// id per atlas texel; the grid only resolves texels on a border
+IdRaster idRaster;
+
+// territory under the cursor, from passive motion
+int hoverTerr = -1;
+int lastMouseX = -1, lastMouseY = -1;
+// world rectangle inside hoverTerr (or inside no territory) where the
+// cursor can move without a re-pick; empty when x0 > x1
+const int kHoverRectCells = 64; // raster cells a side, at most
+float hoverX0 = 1.0f, hoverY0 = 1.0f, hoverX1 = 0.0f, hoverY1 = 0.0f;
+
 // NEW: world map texture
 GLuint worldTex = 0;
 int worldTexW = 0, worldTexH = 0;
@@ -33,24 +82,12 @@ void screenToWorld(int sx, int sy, float &wx, float &wy) {
     wy = ndcY / camZoom + camY;
 }
 
-// point in convex quad test (simple)
-bool pointInPoly(const Territory &t, float x, float y) {
-    bool inside = false;
-    int n = (int)t.polyX.size();
-    for (int i = 0, j = n - 1; i < n; j = i++) {
-        float xi = t.polyX[i], yi = t.polyY[i];
-        float xj = t.polyX[j], yj = t.polyY[j];
-
-        // Check if the edge (xj,yj)->(xi,yi) straddles the horizontal ray at y
-        bool intersect = ((yi > y) != (yj > y)) &&
-                         (x < (xj - xi) * (y - yi) / (yj - yi + 1e-6f) + xi);
-        if (intersect)
-            inside = !inside;
-    }
-    return inside;
+// visible world rectangle for the current camera
+void viewRect(float &x0, float &y0, float &x1, float &y1) {
+    screenToWorld(0, windowHeight, x0, y0);
+    screenToWorld(windowWidth, 0, x1, y1);
 }
 
-
 // draw bitmap text at world coords
 void drawText(float x, float y, const std::string &s, float r, float g, float b) {
     glColor3f(r,g,b);
@@ -62,25 +99,15 @@ void drawText(float x, float y, const std::string &s, float r, float g, float b)
 
 
 
-// draw a single territory polygon
-void drawTerritory(const Territory &t, bool highlight=false){
-    // base color by owner
-    float baseR = t.r;
-    float baseG = t.g;
-    float baseB = t.b;
-    if (t.owner == 0) { // player1 red-ish
-        baseR = 1.0f; baseG *=0.4f; baseB *=0.4f;
-    } else if (t.owner == 1) { // player2 blue-ish
-        baseR *=0.4f; baseG *=0.4f; baseB = 1.0f;
-    } else { // neutral gray
-        baseR = baseG = baseB = 0.5f;
-    }
+// draw a single territory polygon at a level of detail; one folded away at
+// that level has no triangles, its neighbors cover it
+void drawTerritory(int terrIdx, int lodLevel, bool highlight=false){
+    const MapData &map = *game.map;
+    const Territory &t = game.terrs[terrIdx];
 
-    if (highlight){
-        baseR = std::min(baseR+0.3f,1.0f);
-        baseG = std::min(baseG+0.3f,1.0f);
-        baseB = std::min(baseB+0.3f,1.0f);
-    }
+    // base color by owner
+    float baseR, baseG, baseB;
+    territoryBaseColor(game, terrIdx, highlight, baseR, baseG, baseB);
 
     float finalR = baseR;
     float finalG = baseG;
@@ -110,20 +137,89 @@ void drawTerritory(const Territory &t, bool highlight=false){
         finalB = (1.0f - w)*finalB + w*gB;
     }
 
+    // fill from the map's triangulation, so concave outlines draw right
     glColor4f(finalR, finalG, finalB, 0.65f);
-    glBegin(GL_POLYGON);
-    for (size_t i=0;i<t.polyX.size();i++){
-        glVertex2f(t.polyX[i], t.polyY[i]);
+    int nt;
+    const uint32_t* tri = polyLod.triangles(lodLevel, terrIdx, nt);
+    glBegin(GL_TRIANGLES);
+    for (int i=0;i<nt;i++){
+        glVertex2f(map.verts[2*tri[i]], map.verts[2*tri[i]+1]);
     }
     glEnd();
+}
+
+// borders of the given territories as one line list; a border shared by
+// two territories is stored (and drawn) once
+void drawOutlines(const std::vector<int> &terrIdxs, int lodLevel){
+    const MapData &map = *game.map;
+    static std::vector<uint32_t> lines;
+    lines.clear();
+    for (int i : terrIdxs) polyLod.appendLines(lodLevel, i, lines);
 
-    // outline
     glColor4f(0,0,0, 0.9f);
+    glBegin(GL_LINES);
+    for (uint32_t v : lines){
+        glVertex2f(map.verts[2*v], map.verts[2*v+1]);
+    }
+    glEnd();
+}
+
+// thick outline marking a valid attack / fortify target, at a finer level
+// if it is folded away at this one
+void drawTargetOutline(int terrIdx, int lodLevel){
+    const MapData &map = *game.map;
+    int n;
+    const uint32_t* ring = polyLod.ring(lodLevel, terrIdx, n);
+    while (n == 0 && lodLevel > 0) ring = polyLod.ring(--lodLevel, terrIdx, n);
+
+    glLineWidth(3.0f);
+    glColor4f(1.0f, 0.9f, 0.1f, 0.95f);
     glBegin(GL_LINE_LOOP);
-    for (size_t i=0;i<t.polyX.size();i++){
-        glVertex2f(t.polyX[i], t.polyY[i]);
+    for (int i=0;i<n;i++){
+        uint32_t v = map.edgeFrom(ring[i]);
+        glVertex2f(map.verts[2*v], map.verts[2*v+1]);
     }
     glEnd();
+    glLineWidth(1.0f);
+}
+
+// progress along the recording, drawn in NDC
+void drawReplayBar(){
+    float n = (float)std::max<size_t>(1, replay.actions());
+    float x = kBarX0 + (kBarX1 - kBarX0) * (float)replayPos / n;
+    glColor4f(0.2f, 0.2f, 0.2f, 0.5f);
+    glRectf(kBarX0, kBarY0, kBarX1, kBarY1);
+    glColor4f(1.0f, 0.9f, 0.1f, 0.9f);
+    glRectf(kBarX0, kBarY0, x, kBarY1);
+}
+
+// Territories the selected source (or, before a selection, the hovered
+// one) could attack or fortify into this phase. Fortify targets can be
+// anywhere the player's land reaches, so only visible ones are listed.
+void collectTargets(const std::vector<int> &visible, std::vector<int> &out){
+    out.clear();
+    bool attacking  = game.phase == PHASE_ATTACK;
+    bool fortifying = game.phase == PHASE_FORTIFY && !game.fortifyDone;
+    if (replaying || game.gameOver || !(attacking || fortifying)) return;
+
+    int src = attacking ? game.attackSel.fromTerr : game.fortSel.fromTerr;
+    if (src < 0) src = hoverTerr;
+    if (src < 0 || !game.isOwner(src, game.currentPlayer)) return;
+
+    if (fortifying){
+        for (int n : visible){
+            if (game.canFortify(src, n, 1)) out.push_back(n);
+        }
+        return;
+    }
+
+    // neighbors is exactly the set isAdjacent(src, n) accepts
+    int count;
+    const uint32_t* nb = game.map->neighbors(src, count);
+    for (int k = 0; k < count; ++k){
+        int n = (int)nb[k];
+        if (!game.isOwner(n, game.currentPlayer)) out.push_back(n);
+    }
 }
 
 
@@ -134,28 +230,64 @@ void displayCB(){
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
 
-    // Apply camera: translate, then scale
-    glTranslatef(-camX, -camY, 0.0f);
+    // Apply camera: ndc = (world - cam) * zoom, the inverse of screenToWorld
     glScalef(camZoom, camZoom, 1.0f);
+    glTranslatef(-camX, -camY, 0.0f);
 
     
     // --- draw world map background ---
     drawWorldMap();
 
+    // size of one screen pixel in world units picks the outline detail
+    float pixelWorld = 2.0f / (camZoom * (float)std::max(windowWidth, windowHeight));
+    int lodLevel = polyLod.levelFor(pixelWorld);
+
+    // cull against the view; only visible territories are drawn or labeled
+    const MapData &map = *game.map;
+    float vx0, vy0, vx1, vy1;
+    viewRect(vx0, vy0, vx1, vy1);
+    auto offView = [&](int i){
+        const float* b = &map.bounds[4*i];
+        return b[2] < vx0 || b[0] > vx1 || b[3] < vy0 || b[1] > vy1;
+    };
+    static std::vector<int> visible;
+    visible.clear();
+    for (int i=0;i<(int)game.terrs.size();i++){
+        if (offView(i)) continue;
+        visible.push_back(i);
+    }
+
     // draw territories
-    for (size_t i=0;i<game.terrs.size();i++){
-        bool hl = false;
-        if (game.phase == PHASE_ATTACK && (int)i == game.attackSel.fromTerr) hl = true;
-        if (game.phase == PHASE_FORTIFY && (int)i == game.fortSel.fromTerr) hl = true;
-        drawTerritory(game.terrs[i], hl);
+    for (int i : visible){
+        bool hl = (i == hoverTerr);
+        if (game.phase == PHASE_ATTACK && i == game.attackSel.fromTerr) hl = true;
+        if (game.phase == PHASE_FORTIFY && i == game.fortSel.fromTerr) hl = true;
+        drawTerritory(i, lodLevel, hl);
+    }
+    drawOutlines(visible, lodLevel);
+
+    // outline what the hovered / selected territory can act on
+    static std::vector<int> targets;
+    collectTargets(visible, targets);
+    for (int i : targets){
+        if (offView(i)) continue;
+        drawTargetOutline(i, lodLevel);
     }
 
-    // draw army counts
-    for (size_t i=0;i<game.terrs.size();i++){
+    // draw army counts, skipping territories too small on screen to read
+    const float minLabelPixels = 12.0f;
+    float pxPerWorldX = camZoom * windowWidth  * 0.5f;
+    float pxPerWorldY = camZoom * windowHeight * 0.5f;
+    for (int i : visible){
+        const float* b = &map.bounds[4*i];
+        if ((b[2] - b[0]) * pxPerWorldX < minLabelPixels &&
+            (b[3] - b[1]) * pxPerWorldY < minLabelPixels) continue;
+        float lx = map.labels[2*i], ly = map.labels[2*i+1];
+        if (lx < vx0 || lx > vx1 || ly < vy0 || ly > vy1) continue;
         char buf[64];
         std::snprintf(buf, 64, "%d", game.terrs[i].armies);
-        drawText(game.terrs[i].labelX,
-                 game.terrs[i].labelY,
+        drawText(lx,
+                 ly,
                  buf,
                  0,0,0);
     }
@@ -165,7 +297,15 @@ void displayCB(){
 
     // Build the non-player part of the status string
     std::string info;
-    if (game.gameOver) {
+    if (replaying) {
+        drawReplayBar();
+        char speed[32];
+        std::snprintf(speed, sizeof(speed), "x%g", replaySpeed);
+        info = " | REPLAY " + std::to_string(replayPos) + "/" + std::to_string(replay.actions()) +
+               " " + speed + (replayPlaying ? " playing" : " paused") +
+               " | " + (game.gameOver ? "Game over" : game.phaseName()) +
+               " | SPACE play, [ ] speed, arrows/PgUp/PgDn/Home/End or bar seek";
+    } else if (game.gameOver) {
         info = "GAME OVER! Winner: Player " + std::to_string(game.winner+1);
     } else {
         info = " | Phase: " + game.phaseName();
@@ -177,10 +317,15 @@ void displayCB(){
             info += " | Click YOUR territory, then ENEMY";
         }
         if (game.phase == PHASE_FORTIFY) {
-            info += " | Click YOUR source, then YOUR neighbor (once)";
+            info += " | Click YOUR source, then YOUR connected territory (once, SHIFT=all armies)";
         }
 
-        info += " | ENTER=NextPhase";
+        info += " | ENTER=NextPhase U/R=Undo/Redo";
+    }
+    if (online) {
+        info += !server.connected() ? " | OFFLINE" :
+                server.seat() < 0 ? " | Watching" :
+                " | You: Player " + std::to_string(server.seat() + 1);
     }
 
     // Draw “Player X” separately so we can color it
@@ -204,6 +349,28 @@ void displayCB(){
     glutSwapBuffers();
 }
 
+// re-pick the hovered territory; redraw only when it changes
+void updateHover(int x, int y){
+    lastMouseX = x;
+    lastMouseY = y;
+
+    float wx, wy;
+    screenToWorld(x,y,wx,wy);
+
+    // most motion events stay inside the rectangle the last pick found
+    if (wx >= hoverX0 && wx < hoverX1 && wy >= hoverY0 && wy < hoverY1) return;
+
+    int h = idRaster.pick(pickGrid, wx, wy);
+    if (!idRaster.stableRect(wx, wy, kHoverRectCells, hoverX0, hoverY0, hoverX1, hoverY1)) {
+        hoverX0 = hoverY0 = 1.0f;
+        hoverX1 = hoverY1 = 0.0f;
+    }
+    if (h != hoverTerr) {
+        hoverTerr = h;
+        glutPostRedisplay();
+    }
+}
+
 void reshapeCB(int w, int h){
     windowWidth = w;
     windowHeight = h;
@@ -213,57 +380,102 @@ void reshapeCB(int w, int h){
     gluOrtho2D(-1,1,-1,1);
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
+    // the same cursor position is somewhere else on the map now
+    if (lastMouseX >= 0) updateHover(lastMouseX, lastMouseY);
 }
 
-// handle clicks based on phase
-void handleClick(int terrIdx){
-    if (game.gameOver) return;
+// jump anywhere; the view is rebuilt from the nearest keyframe
+void replaySeek(size_t pos){
+    replayPos = std::min(pos, replay.actions());
+    replay.seek(game, replayPos);
+    replayOwed = 0.0;
+    glutPostRedisplay();
+}
 
-    if (terrIdx < 0) return;
+// play on by however long it has been since the last idle call
+void advanceReplay(){
+    int now = glutGet(GLUT_ELAPSED_TIME);
+    int elapsed = now - replayTick;
+    replayTick = now;
+    if (!replayPlaying) return;
+
+    float rate = kReplayRate * replaySpeed;
+    replayOwed += rate * elapsed / 1000.0;
+    if (replayOwed >= Replay::kKeyframeInterval) {
+        // far behind (fast, or a stalled window): seeking beats stepping
+        replaySeek(replayPos + (size_t)replayOwed);
+    }
+    bool moved = false;
+    while (replayOwed >= 1.0 && replayPos < replay.actions()) {
+        replay.stepForward(game, replayPos++, rate <= kReplayFlashLimit);
+        replayOwed -= 1.0;
+        moved = true;
+    }
+    if (replayPos >= replay.actions()) {
+        replayPlaying = false;
+        replayOwed = 0.0;
+    }
+    if (moved) glutPostRedisplay();
+}
 
-    switch(game.phase){
-        case PHASE_REINFORCE:
-            game.placeReinforcement(terrIdx);
-            break;
+// seek to the timeline position under screen x, if (x, y) is on the bar
+bool scrubTo(int x, int y, bool anywhere){
+    float nx = 2.0f * x / windowWidth - 1.0f;
+    float ny = 1.0f - 2.0f * y / windowHeight;
+    if (!anywhere && (nx < kBarX0 || nx > kBarX1 || ny < kBarY0 || ny > kBarY1)) return false;
+    float f = std::max(0.0f, std::min(1.0f, (nx - kBarX0) / (kBarX1 - kBarX0)));
+    replaySeek((size_t)(f * replay.actions() + 0.5f));
+    return true;
+}
 
-        case PHASE_ATTACK:
-            // if we haven't picked from
-            if (game.attackSel.fromTerr < 0) {
-                game.selectAttackFrom(terrIdx);
-            } else {
-                game.selectAttackTo(terrIdx);
-            }
-            break;
+// to whoever holds the game
+void postCommand(const Command &cmd){
+    bool ok = online ? server.post(cmd) : logic.post(cmd);
+    if (!ok) std::fprintf(stderr, "command dropped\n");
+}
 
-        case PHASE_FORTIFY:
-            if (game.fortifyDone) {
-                // can't fortify again, ignore clicks
-                break;
-            }
-            if (game.fortSel.fromTerr < 0) {
-                game.selectFortifyFrom(terrIdx);
-            } else {
-                game.selectFortifyTo(terrIdx);
-            }
-            break;
+// handle clicks: the game thread resolves them against its current phase.
+// A shifted fortify click moves every army but one.
+void handleClick(int terrIdx, bool shift){
+    if (terrIdx < 0) return;
+
+    Command cmd;
+    cmd.type = CMD_CLICK;
+    cmd.terr = terrIdx;
+    int src = game.fortSel.fromTerr;
+    if (shift && game.phase == PHASE_FORTIFY && src >= 0){
+        cmd.armies = std::max(1, game.terrs[src].armies - 1);
     }
+    postCommand(cmd);
+}
+
+// passive motion callback (no button held)
+void motionCB(int x, int y){
+    updateHover(x, y);
+}
+
+// motion with a button held: scrubbing the replay timeline
+void dragCB(int x, int y){
+    if (replayScrubbing) scrubTo(x, y, true);
+    updateHover(x, y);
 }
 
 // mouse callback
 void mouseCB(int button, int state, int x, int y){
+    if (replaying){
+        // the map is read-only; only the timeline takes clicks
+        if (button == GLUT_LEFT_BUTTON){
+            replayScrubbing = state == GLUT_DOWN && scrubTo(x, y, false);
+        }
+        return;
+    }
     if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN){
         float wx, wy;
         screenToWorld(x,y,wx,wy);
 
         // find which territory
-        int clicked = -1;
-        for (int i=0;i<(int)game.terrs.size();i++){
-            if (pointInPoly(game.terrs[i], wx, wy)){
-                clicked = i;
-                break;
-            }
-        }
-        handleClick(clicked);
+        int clicked = idRaster.pick(pickGrid, wx, wy);
+        handleClick(clicked, (glutGetModifiers() & GLUT_ACTIVE_SHIFT) != 0);
 
         glutPostRedisplay();
     }
@@ -271,12 +483,36 @@ void mouseCB(int button, int state, int x, int y){
 
 // keyboard callback
 void keyCB(unsigned char key, int x, int y){
-    if (key == 27) { // ESC
+    if (key == 27 && (replaying || online)) std::exit(0); // the server keeps its game
+    if (key == 27) { // ESC: keep the game for --load
+        logic.stop();
+        std::string err;
+        if (saveSnapshot(logic.state(), kSavePath, err)) std::printf("game saved to %s\n", kSavePath);
+        else std::fprintf(stderr, "WARNING: %s\n", err.c_str());
         std::exit(0);
     }
-    if (key == '\r' || key == '\n') {
+    if ((key == '\r' || key == '\n') && !replaying) {
         // ENTER
-        game.nextPhase();
+        Command cmd;
+        cmd.type = CMD_NEXT_PHASE;
+        postCommand(cmd);
+    }
+    if ((key == 'u' || key == 26 || key == 'r' || key == 25) && !replaying) {
+        // U or Ctrl+Z undoes, R or Ctrl+Y redoes; dice rolls are final
+        Command cmd;
+        cmd.type = key == 'u' || key == 26 ? CMD_UNDO : CMD_REDO;
+        postCommand(cmd);
+    }
+    if (replaying) {
+        switch (key) {
+            case ' ':
+                if (!replayPlaying && replayPos >= replay.actions()) replaySeek(0);
+                replayPlaying = !replayPlaying;
+                replayOwed = 0.0;
+                break;
+            case ']': replaySpeed = std::min(256.0f, replaySpeed * 2.0f); break;
+            case '[': replaySpeed = std::max(0.125f, replaySpeed * 0.5f); break;
+        }
     }
       const float panStep = 0.1f / camZoom;   // pan smaller when zoomed in
     const float zoomStep = 0.1f;
@@ -297,11 +533,35 @@ void keyCB(unsigned char key, int x, int y){
             if (camZoom < 0.2f) camZoom = 0.2f;
             break;
     }
+    // the camera may have moved another territory under a still cursor
+    if (lastMouseX >= 0) updateHover(lastMouseX, lastMouseY);
+    glutPostRedisplay();
+}
+
+// replay: arrows step one action, page keys jump a tenth, home/end go to the ends
+void specialCB(int key, int, int){
+    if (!replaying) return;
+    size_t n = replay.actions();
+    size_t jump = std::max<size_t>(1, n / 10);
+    switch (key) {
+        case GLUT_KEY_RIGHT:
+            if (replayPos < n) replay.stepForward(game, replayPos++, true);
+            break;
+        case GLUT_KEY_LEFT:      replaySeek(replayPos > 0 ? replayPos - 1 : 0); break;
+        case GLUT_KEY_PAGE_UP:   replaySeek(replayPos + jump); break;
+        case GLUT_KEY_PAGE_DOWN: replaySeek(replayPos > jump ? replayPos - jump : 0); break;
+        case GLUT_KEY_HOME:      replaySeek(0); break;
+        case GLUT_KEY_END:       replaySeek(n); break;
+        default: return;
+    }
+    replayPlaying = false;
     glutPostRedisplay();
 }
 
 void updateAnimation() {
-    const float dt = 0.02f;
+    // fast replays run the flashes fast too, so they don't pile up
+    float dt = 0.02f;
+    if (replaying && replayPlaying) dt *= std::max(1.0f, replaySpeed);
 
     bool anyAnimating = false;
     for (auto &t : game.terrs) {
@@ -330,34 +590,43 @@ void updateAnimation() {
 }
 
 void idleCB() {
+    if (replaying) advanceReplay();
+    else if (online ? server.poll(game) : logic.poll(game)) glutPostRedisplay();
     updateAnimation();
 }
 
 bool loadWorldTexture(const char* filename) {
-    int nChannels;
-    unsigned char* data = stbi_load(filename, &worldTexW, &worldTexH, &nChannels, 3);
-    if (!data) {
+    // mip chain comes from <filename>.texcache when fresh, else from a decode
+    TexCache tex;
+    if (!tex.load(filename)) {
         std::fprintf(stderr, "Failed to load image %s\n", filename);
         return false;
     }
+    worldTexW = tex.levels[0].w;
+    worldTexH = tex.levels[0].h;
 
     glGenTextures(1, &worldTex);
     glBindTexture(GL_TEXTURE_2D, worldTex);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    // trilinear, so the atlas doesn't shimmer when zoomed out
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    glTexImage2D(GL_TEXTURE_2D,
-                 0,
-                 GL_RGB,
-                 worldTexW,
-                 worldTexH,
-                 0,
-                 GL_RGB,
-                 GL_UNSIGNED_BYTE,
-                 data);
-
-    stbi_image_free(data);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)tex.levels.size() - 1);
+
+    // cache rows are tightly packed RGB
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t i = 0; i < tex.levels.size(); ++i) {
+        glTexImage2D(GL_TEXTURE_2D,
+                     (GLint)i,
+                     GL_RGB,
+                     tex.levels[i].w,
+                     tex.levels[i].h,
+                     0,
+                     GL_RGB,
+                     GL_UNSIGNED_BYTE,
+                     tex.levels[i].pixels);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     return true;
 }
 
@@ -380,7 +649,100 @@ void drawWorldMap() {
 }
 
 
+// headless: risk --render out.ppm [width height [threads]]
+int renderHeadless(int argc, char** argv){
+    SoftRenderOptions opt;
+    if (argc > 4) {
+        opt.width  = std::atoi(argv[3]);
+        opt.height = std::atoi(argv[4]);
+    }
+    if (argc > 5) opt.threads = std::atoi(argv[5]);
+    if (opt.width <= 0 || opt.height <= 0) {
+        std::fprintf(stderr, "bad image size\n");
+        return 1;
+    }
+
+    TexCache atlas;
+    if (atlas.load("atlas.jpg")) opt.atlas = &atlas;
+    polyLod.bind(*game.map);
+    opt.lod = &polyLod;
+
+    Image img;
+    renderGame(game, opt, img);
+    if (!writePPM(img, argv[2])) {
+        std::fprintf(stderr, "could not write %s\n", argv[2]);
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char** argv){
+    // --map <file> chooses the map (text, or .rmap from risk_mapc),
+    // --load <file> resumes a saved game or journal on it,
+    // --record <file> journals the game from there on, and
+    // --replay <file> plays a journal back instead, and --connect
+    // <host:port> joins a risk_server game on the same map, the next
+    // open seat or --game <id>, with :<token> to take back a seat held
+    // before; all are removed before the other options
+    const char* mapPath = "maps/world.map";
+    const char* savePath = nullptr;
+    const char* recordPath = nullptr;
+    const char* replayPath = nullptr;
+    const char* connectTo = nullptr;
+    const char* joinGame = nullptr;
+    for (int i = 1; i + 1 < argc; ) {
+        std::string opt = argv[i];
+        const char** target = opt == "--map" ? &mapPath :
+                              opt == "--load" ? &savePath :
+                              opt == "--record" ? &recordPath :
+                              opt == "--replay" ? &replayPath :
+                              opt == "--connect" ? &connectTo :
+                              opt == "--game" ? &joinGame : nullptr;
+        if (!target) { ++i; continue; }
+        *target = argv[i+1];
+        for (int k = i; k + 2 < argc; ++k) argv[k] = argv[k+2];
+        argc -= 2;
+        argv[argc] = nullptr;
+    }
+    std::string err;
+    if (!game.loadMap(mapPath, err)) {
+        std::fprintf(stderr, "WARNING: %s, using the built-in map\n", err.c_str());
+    }
+    if (savePath) {
+        Journal journal;
+        bool ok = isJournalFile(savePath)
+                      ? readJournal(savePath, journal, err) &&
+                        replayJournal(game, journal, journal.records.size(), err)
+                      : loadSnapshot(game, savePath, err);
+        if (!ok) {
+            std::fprintf(stderr, "WARNING: %s, starting a new game\n", err.c_str());
+            game.newGame();
+        }
+    }
+
+    if (replayPath) {
+        Journal journal;
+        replaying = readJournal(replayPath, journal, err) && replay.build(game, journal, err);
+        if (replaying) replay.seek(game, 0);
+        else std::fprintf(stderr, "WARNING: %s, not replaying\n", err.c_str());
+    }
+
+    if (connectTo && !replaying) {
+        char* rest = nullptr;
+        uint64_t id = joinGame ? std::strtoull(joinGame, &rest, 10) : 0;
+        uint64_t token = rest && *rest == ':' ? std::strtoull(rest + 1, nullptr, 16) : 0;
+        online = server.connect(connectTo, id, token, game, err);
+        if (!online) std::fprintf(stderr, "WARNING: %s, playing locally\n", err.c_str());
+        else if (server.seat() < 0) std::printf("watching game %llu\n", (unsigned long long)server.gameId());
+        else std::printf("joined game %llu, back into this seat with --game %llu:%llx\n",
+                         (unsigned long long)server.gameId(), (unsigned long long)server.gameId(),
+                         (unsigned long long)server.token());
+    }
+
+    if (argc > 2 && std::string(argv[1]) == "--render") {
+        return renderHeadless(argc, argv);
+    }
+
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
     glutInitWindowSize(windowWidth, windowHeight);
@@ -391,17 +753,41 @@ int main(int argc, char** argv){
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+    polyLod.bind(*game.map);
+    pickGrid.build(*game.map);
+
     // load the world map texture
     if (!loadWorldTexture("atlas.jpg")) {
         std::fprintf(stderr, "WARNING: could not load atlas.jpg\n");
     }
+    idRaster.build(*game.map, pickGrid,
+                   worldTexW > 0 ? worldTexW : 800,
+                   worldTexH > 0 ? worldTexH : 400);
 
     glutDisplayFunc(displayCB);
     glutReshapeFunc(reshapeCB);
     glutKeyboardFunc(keyCB);
     glutMouseFunc(mouseCB);
+    glutPassiveMotionFunc(motionCB);
+    glutMotionFunc(dragCB);
+    glutSpecialFunc(specialCB);
     glutIdleFunc(idleCB);
 
+    if (replaying) {
+        replayTick = glutGet(GLUT_ELAPSED_TIME);
+        glutMainLoop();
+        return 0;
+    }
+    if (online) {
+        glutMainLoop();
+        return 0;
+    }
+
+    if (recordPath && !logic.record(recordPath, game, true, err)) {
+        std::fprintf(stderr, "WARNING: %s, not recording\n", err.c_str());
+    }
+    logic.start(game);
+
     glutMainLoop();
     return 0;
 }
@@ -0,0 +1,277 @@
+// server.cpp
+// risk_server: hosts any number of games for whoever connects (see
+// net.h). This thread accepts connections and reads their JOIN; the
+// games themselves live on worker shards, one per core (see shard.h),
+// and a connection is handed to the shard its game is on. A JOIN for no
+// particular game takes the open seat of the last game started, or
+// starts one on the least loaded shard.
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "game.h"
+#include "net.h"
+#include "shard.h"
+
+namespace {
+
+volatile std::sig_atomic_t stopping = 0;
+
+void onSignal(int) { stopping = 1; }
+
+class Acceptor {
+public:
+    explicit Acceptor(std::vector<std::unique_ptr<Shard>> &s) : shards(s) {}
+    bool listen(const char* hostPort, std::string &err);
+    void run();
+    void shutdown();
+
+private:
+    std::vector<std::unique_ptr<Shard>> &shards;
+    int listenFd = -1;
+    int epfd = -1;
+    bool paused = false;      // listenFd out of epoll, out of descriptors
+    std::unordered_map<int, NetConn> joining; // by fd, until their JOIN
+    uint64_t started = 0;     // games started so far
+    uint64_t openGame = 0;    // started, waiting for its second player
+
+    void accept();
+    void resume();
+    void readFrom(NetConn &c);
+    void route(NetConn &c, const NetJoin &join);
+    void drop(int fd);
+};
+
+bool Acceptor::listen(const char* hostPort, std::string &err) {
+    listenFd = netListen(hostPort, err);
+    if (listenFd < 0) return false;
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = listenFd;
+    if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, listenFd, &ev) < 0) {
+        err = std::string("epoll: ") + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+void Acceptor::run() {
+    const int kRetryMs = 100; // shards free descriptors without telling us
+    epoll_event events[64];
+    while (!stopping) {
+        int n = epoll_wait(epfd, events, 64, paused ? kRetryMs : -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::perror("epoll_wait");
+            return;
+        }
+        if (n == 0) resume();
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                accept();
+                continue;
+            }
+            auto it = joining.find(fd);
+            if (it == joining.end()) continue;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) drop(fd);
+            else readFrom(it->second);
+        }
+    }
+}
+
+void Acceptor::shutdown() {
+    for (auto &kv : joining) kv.second.close();
+    joining.clear();
+    if (listenFd >= 0) close(listenFd);
+    if (epfd >= 0) close(epfd);
+    listenFd = epfd = -1;
+}
+
+void Acceptor::accept() {
+    for (;;) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0 && (errno == EMFILE || errno == ENFILE)) {
+            // the listen fd stays readable, so leave it out of epoll until
+            // a descriptor frees; the connection waits in the backlog
+            epoll_ctl(epfd, EPOLL_CTL_DEL, listenFd, nullptr);
+            paused = true;
+            return;
+        }
+        if (fd < 0) return; // EAGAIN
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            continue;
+        }
+        joining[fd].fd = fd;
+    }
+}
+
+void Acceptor::resume() {
+    if (!paused) return;
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = listenFd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listenFd, &ev) == 0) paused = false;
+}
+
+void Acceptor::readFrom(NetConn &c) {
+    int fd = c.fd;
+    bool open = c.readAvailable();
+    uint8_t type;
+    const unsigned char* body;
+    uint32_t len;
+    if (c.nextMessage(type, body, len)) {
+        NetJoin join;
+        if (type != MSG_JOIN || len != sizeof(join)) {
+            drop(fd);
+            return;
+        }
+        std::memcpy(&join, body, sizeof(join));
+        route(c, join);
+        return;
+    }
+    if (!open || c.fd < 0) drop(fd);
+}
+
+// game ids carry their shard: started * shards + shard, so never 0
+void Acceptor::route(NetConn &c, const NetJoin &join) {
+    Handoff h;
+    uint64_t game = join.game;
+    if (openGame != 0 && shards[openGame % shards.size()]->deserted() == openGame) openGame = 0;
+    if (game == 0 && openGame != 0) {
+        game = openGame;
+        openGame = 0;
+        h.open = true;
+    } else if (game == 0) {
+        // fewest connections, then fewest games
+        size_t least = 0;
+        for (size_t s = 1; s < shards.size(); ++s) {
+            int a = shards[s]->load(), b = shards[least]->load();
+            if (a < b || (a == b && shards[s]->games() < shards[least]->games())) least = s;
+        }
+        game = ++started * shards.size() + least;
+        h.create = true;
+        openGame = game;
+    }
+    int fd = c.fd;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+    h.conn = c;
+    h.game = game;
+    h.token = join.token;
+    joining.erase(fd); // the shard has it now
+    size_t shard = game % shards.size();
+    if (!shards[shard]->hand(h)) {
+        std::fprintf(stderr, "WARNING: shard %zu is not keeping up, connection dropped\n", shard);
+        close(fd);
+        if (h.create) openGame = 0;
+    }
+}
+
+void Acceptor::drop(int fd) {
+    auto it = joining.find(fd);
+    if (it == joining.end()) return;
+    if (it->second.fd >= 0) epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+    it->second.close();
+    joining.erase(it);
+    resume();
+}
+
+int usage(const char* prog) {
+    std::fprintf(stderr,
+        "usage: %s [--listen [host:]port] [--map <file>] [--shards n] [--record <dir>]\n"
+        "  listens on 127.0.0.1:7777 with a shard per core by default; --record\n"
+        "  journals every game into dir; ^C stops and closes the journals\n",
+        prog);
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const char* listenOn = "7777";
+    const char* mapPath = "maps/world.map";
+    const char* recordDir = nullptr;
+    const char* shardCount = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        std::string opt = argv[i];
+        const char** target = opt == "--listen" ? &listenOn :
+                              opt == "--map" ? &mapPath :
+                              opt == "--shards" ? &shardCount :
+                              opt == "--record" ? &recordDir : nullptr;
+        if (!target || i + 1 >= argc) return usage(argv[0]);
+        *target = argv[++i];
+    }
+    int nShards = shardCount ? std::atoi(shardCount) : (int)std::thread::hardware_concurrency();
+    if (nShards < 1) nShards = 1;
+
+    // one map for every game on every shard
+    Game proto;
+    std::string err;
+    if (!proto.loadMap(mapPath, err)) {
+        std::fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+    }
+
+    // the shards leave signals to this thread
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigs, nullptr);
+    std::random_device entropy;
+    uint64_t seed = (uint64_t)entropy() << 32 | entropy();
+    std::vector<std::unique_ptr<Shard>> shards;
+    for (int s = 0; s < nShards; ++s) {
+        shards.emplace_back(new Shard(proto, seed, recordDir));
+        if (!shards.back()->start(err)) {
+            std::fprintf(stderr, "%s\n", err.c_str());
+            return 1;
+        }
+    }
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal; // no SA_RESTART, so epoll_wait returns
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    pthread_sigmask(SIG_UNBLOCK, &sigs, nullptr);
+
+    Acceptor acceptor(shards);
+    if (!acceptor.listen(listenOn, err)) {
+        std::fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+    }
+    std::printf("serving %zu territories on %s, %d shards\n",
+                proto.terrs.size(), listenOn, nShards);
+    std::fflush(stdout);
+    acceptor.run();
+    acceptor.shutdown();
+
+    size_t games = 0, live = 0;
+    for (auto &s : shards) {
+        games += s->games();
+        live += s->liveGames();
+    }
+    for (auto &s : shards) s->stop();
+    std::printf("stopped with %zu games, %zu of them live\n", games, live);
+    return 0;
+}
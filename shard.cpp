@@ -0,0 +1,373 @@
+// shard.cpp
+#include "shard.h"
+#include "snapshot.h"
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t  kMaxBacklog = 64u << 20; // a client this far behind is dropped
+const int64_t kParkAfterMs = 30000;    // without a command
+const int64_t kExpireAfterMs = 600000; // with nobody seated
+const int     kSweepMs = 1000;
+
+int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void serialize(const Game &g, std::vector<unsigned char> &out) {
+    out.resize(snapshotMaxBytes(g));
+    out.resize(writeSnapshot(g, out.data()));
+}
+
+} // namespace
+
+Shard::Shard(const Game &p, uint64_t s, const char* dir)
+    : proto(p), seed(s), recordDir(dir ? dir : "") {}
+
+Shard::~Shard() {
+    stop();
+}
+
+void* Shard::operator new(size_t bytes) {
+    void* p = nullptr;
+    if (posix_memalign(&p, alignof(Shard), bytes) != 0) throw std::bad_alloc();
+    return p;
+}
+
+void Shard::operator delete(void* p) {
+    std::free(p);
+}
+
+bool Shard::start(std::string &err) {
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeFd;
+    if (epfd < 0 || wakeFd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, wakeFd, &ev) < 0) {
+        err = std::string("shard: ") + std::strerror(errno);
+        return false;
+    }
+    running = true;
+    worker = std::thread(&Shard::run, this);
+    return true;
+}
+
+void Shard::stop() {
+    if (worker.joinable()) {
+        running = false;
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {} // the loop also wakes to sweep
+        worker.join();
+    }
+    if (epfd >= 0) close(epfd);
+    if (wakeFd >= 0) close(wakeFd);
+    epfd = wakeFd = -1;
+}
+
+bool Shard::hand(const Handoff &h) {
+    connections.fetch_add(1, std::memory_order_relaxed); // before the shard can drop it
+    if (!inbox.push(h)) {
+        connections.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {} // already rung
+    return true;
+}
+
+void Shard::run() {
+    epoll_event events[64];
+    Handoff h;
+    while (running) {
+        int n = epoll_wait(epfd, events, 64, kSweepMs);
+        if (n < 0 && errno != EINTR) {
+            std::perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == wakeFd) {
+                uint64_t rung;
+                if (read(wakeFd, &rung, sizeof(rung)) < 0) {}
+                while (inbox.pop(h)) attach(h);
+                continue;
+            }
+            auto it = clients.find(fd);
+            if (it == clients.end()) continue; // dropped earlier in this batch
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                drop(fd);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) flush(it->second);
+            it = clients.find(fd);
+            if (it != clients.end() && (events[i].events & EPOLLIN)) readFrom(it->second);
+        }
+        sweep(nowMs());
+    }
+
+    // everyone goes; live games park, which closes their journals
+    while (!clients.empty()) drop(clients.begin()->first);
+    while (!lru.empty()) park(*lru.front());
+}
+
+void Shard::attach(Handoff &h) {
+    auto found = slots.find(h.game);
+    if (found == slots.end() && h.create) {
+        GameSlot &s = slots[h.game];
+        s.id = h.game;
+        s.live.reset(new LiveGame(proto));
+        Game &g = s.live->game;
+        g.seedRng(seed + h.game);
+        g.newGame();
+        serialize(g, s.state);
+        s.live->lastMs = nowMs();
+        s.live->lru = lru.insert(lru.end(), &s);
+        if (!recordDir.empty()) {
+            std::string path = recordDir + "/" + std::to_string(s.id) + ".0.jnl", err;
+            if (!s.live->journal.open(path.c_str(), g, false, err)) {
+                std::fprintf(stderr, "WARNING: %s, not recording\n", err.c_str());
+            }
+        }
+        s.stretches = 1;
+        seatsChanged(s, nowMs()); // vacant until someone sits down
+        gameCount.fetch_add(1, std::memory_order_relaxed);
+        liveCount.fetch_add(1, std::memory_order_relaxed);
+        found = slots.find(h.game);
+    }
+    // an open seat whose game was deserted on the way here would be a
+    // wait for nobody
+    bool deserted = found != slots.end() && h.open &&
+                    found->second.seats[0] < 0 && found->second.seats[1] < 0;
+    if (found == slots.end() || deserted) {
+        h.conn.queue(MSG_REJECT, nullptr, 0);
+        h.conn.flush();
+        h.conn.close();
+        connections.fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+
+    int fd = h.conn.fd;
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        h.conn.close();
+        connections.fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+    GameSlot &s = found->second;
+    Client &c = clients[fd];
+    c.conn = h.conn;
+    c.game = &s;
+    // a token takes back its own seat; no token, a seat never handed out
+    for (int k = 0; k < 2 && c.seat < 0; ++k) {
+        if (s.seats[k] < 0 && s.tokens[k] == h.token) c.seat = k;
+    }
+    if (c.seat >= 0) {
+        s.seats[c.seat] = fd;
+        if (s.tokens[c.seat] == 0) s.tokens[c.seat] = newToken();
+        uint64_t back = s.id; // its player is back, open again
+        desertedGame.compare_exchange_strong(back, 0, std::memory_order_acq_rel);
+    }
+    s.fds.push_back(fd);
+    seatsChanged(s, nowMs());
+
+    NetHello hello = {c.seat, 0, proto.map->fingerprint, s.id, c.seat >= 0 ? s.tokens[c.seat] : 0};
+    send(c, MSG_HELLO, &hello, sizeof(hello));
+    if (clients.count(fd)) send(c, MSG_STATE, s.state.data(), (uint32_t)s.state.size());
+    // it may have sent more after its JOIN
+    if (clients.count(fd)) readFrom(c);
+}
+
+uint64_t Shard::newToken() {
+    uint64_t t = 0;
+    while (t == 0) t = (uint64_t)entropy() << 32 | entropy();
+    return t;
+}
+
+// a parked game comes back from its snapshot
+Shard::LiveGame& Shard::wake(GameSlot &s) {
+    if (s.live) return *s.live;
+    s.live.reset(new LiveGame(proto));
+    LiveGame &lg = *s.live;
+    std::string err;
+    if (!readSnapshot(lg.game, s.state.data(), s.state.size(), err)) {
+        // only ever our own bytes
+        std::fprintf(stderr, "game %llu: %s\n", (unsigned long long)s.id, err.c_str());
+    }
+    if (!recordDir.empty()) {
+        std::string path = recordDir + "/" + std::to_string(s.id) + "." +
+                           std::to_string(s.stretches) + ".jnl";
+        if (!lg.journal.open(path.c_str(), lg.game, false, err)) {
+            std::fprintf(stderr, "WARNING: %s, not recording\n", err.c_str());
+        }
+    }
+    ++s.stretches;
+    lg.lastMs = nowMs();
+    lg.lru = lru.insert(lru.end(), &s);
+    liveCount.fetch_add(1, std::memory_order_relaxed);
+    return lg;
+}
+
+// the snapshot is already current; all that goes is the Game
+void Shard::park(GameSlot &s) {
+    if (!s.live) return;
+    if (!s.live->journal.close()) {
+        std::fprintf(stderr, "WARNING: %s, last turn not recorded\n", s.live->journal.error().c_str());
+    }
+    lru.erase(s.live->lru);
+    s.live.reset();
+    s.state.shrink_to_fit();
+    liveCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void Shard::sweep(int64_t now) {
+    while (!lru.empty() && now - lru.front()->live->lastMs > kParkAfterMs) park(*lru.front());
+    while (!vacant.empty() && now - vacant.front()->vacantMs > kExpireAfterMs) expire(*vacant.front());
+}
+
+// keeps vacant in order of when each game lost its last seated player
+void Shard::seatsChanged(GameSlot &s, int64_t now) {
+    bool empty = s.seats[0] < 0 && s.seats[1] < 0;
+    if (empty == (s.vacantMs >= 0)) return;
+    if (empty) {
+        s.vacantMs = now;
+        s.vacancy = vacant.insert(vacant.end(), &s);
+    } else {
+        vacant.erase(s.vacancy);
+        s.vacantMs = -1;
+    }
+}
+
+// watchers go too; the last of them to go forgets the game
+void Shard::expire(GameSlot &s) {
+    s.over = true;
+    if (s.fds.empty()) {
+        park(s);
+        forget(s);
+        return;
+    }
+    std::vector<int> fds = s.fds;
+    for (int fd : fds) drop(fd);
+}
+
+void Shard::forget(GameSlot &s) {
+    if (s.vacantMs >= 0) vacant.erase(s.vacancy);
+    slots.erase(s.id);
+    gameCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void Shard::readFrom(Client &c) {
+    int fd = c.conn.fd;
+    bool open = c.conn.readAvailable();
+    uint8_t type;
+    const unsigned char* body;
+    uint32_t len;
+    while (clients.count(fd) && c.conn.nextMessage(type, body, len)) {
+        if (type == MSG_COMMAND) command(c, body, len);
+    }
+    // a closed or garbled connection has fd -1 by now
+    if (clients.count(fd) && (!open || c.conn.fd < 0)) drop(fd);
+}
+
+void Shard::command(Client &c, const unsigned char* body, uint32_t len) {
+    GameSlot &s = *c.game;
+    NetCommand nc;
+    bool ok = len == sizeof(nc) && c.seat >= 0;
+    if (ok) {
+        std::memcpy(&nc, body, sizeof(nc));
+        ok = nc.type >= CMD_CLICK && nc.type <= CMD_REDO;
+    }
+    if (ok) {
+        LiveGame &lg = wake(s);
+        Game &g = lg.game;
+        Command cmd;
+        cmd.type = (CommandType)nc.type;
+        cmd.terr = nc.terr;
+        cmd.armies = nc.armies;
+        Command resolved = g.resolve(cmd);
+        ok = c.seat == g.currentPlayer && g.apply(resolved);
+        if (ok) {
+            if (lg.journal.isOpen() && !lg.journal.append(resolved, g)) {
+                std::fprintf(stderr, "WARNING: %s, no longer recording\n", lg.journal.error().c_str());
+            }
+            lg.lastMs = nowMs();
+            s.over = g.gameOver;
+            lru.splice(lru.end(), lru, lg.lru);
+            serialize(g, s.state);
+        }
+    }
+    if (!ok) {
+        send(c, MSG_REJECT, nullptr, 0);
+        return;
+    }
+
+    // one encoding for everyone on the game
+    std::vector<int> fds = s.fds;
+    for (int fd : fds) {
+        auto it = clients.find(fd);
+        if (it != clients.end()) send(it->second, MSG_STATE, s.state.data(), (uint32_t)s.state.size());
+    }
+}
+
+void Shard::send(Client &c, uint8_t type, const void* body, uint32_t len) {
+    c.conn.queue(type, body, len);
+    flush(c);
+}
+
+// writes what the socket takes; EPOLLOUT only while something is left
+void Shard::flush(Client &c) {
+    int fd = c.conn.fd;
+    if (!c.conn.flush() || c.conn.backlog() > kMaxBacklog) {
+        drop(fd);
+        return;
+    }
+    bool want = c.conn.backlog() > 0;
+    if (want == c.writable) return;
+    epoll_event ev;
+    ev.events = want ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+    c.writable = want;
+}
+
+void Shard::drop(int fd) {
+    auto it = clients.find(fd);
+    if (it == clients.end()) return;
+    Client &c = it->second;
+    GameSlot &s = *c.game;
+    if (c.seat >= 0) {
+        s.seats[c.seat] = -1;
+        // nobody else ever sat down
+        if (s.tokens[1 - c.seat] == 0) desertedGame.store(s.id, std::memory_order_release);
+    }
+    seatsChanged(s, nowMs());
+    for (size_t k = 0; k < s.fds.size(); ++k) {
+        if (s.fds[k] == fd) {
+            s.fds[k] = s.fds.back();
+            s.fds.pop_back();
+            break;
+        }
+    }
+    // a garbled stream is closed already, which also took it out of epoll
+    if (c.conn.fd >= 0) epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+    c.conn.close();
+    clients.erase(it);
+    connections.fetch_sub(1, std::memory_order_relaxed);
+
+    // nobody left: park it, or forget it once it is over
+    if (!s.fds.empty()) return;
+    s.fds.shrink_to_fit();
+    park(s);
+    if (s.over) forget(s);
+}
@@ -0,0 +1,132 @@
+// shard.h
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "game.h"
+#include "journal.h"
+#include "net.h"
+#include "spsc.h"
+
+// a connection on its way from the acceptor to a shard, with whatever it
+// sent after its JOIN
+struct Handoff {
+    NetConn  conn;
+    uint64_t game = 0;
+    uint64_t token = 0;      // for a seat it held before
+    bool     create = false; // start a new game by this id
+    bool     open = false;   // sent to the open seat, not to a game it asked for
+};
+
+// One worker thread with its own epoll loop and the games placed on it.
+// Only that thread touches the games, so nothing is locked: connections
+// arrive through a queue and the load counter is all others read.
+//
+// A game nobody has played for a while, or that everyone has left, is
+// parked: the live Game goes and only its snapshot stays, which is also
+// what clients are sent. The next command brings it back. Parking drops
+// the undo history, as saving does. A game with nobody seated for
+// kExpireAfterMs is forgotten, and anyone still watching it is dropped.
+class Shard {
+public:
+    // every game is a copy of proto, sharing its map; with a recordDir,
+    // each live stretch of a game is journaled to <dir>/<game>.<n>.jnl
+    Shard(const Game &proto, uint64_t seed, const char* recordDir);
+    ~Shard();
+    Shard(const Shard&) = delete;
+    Shard& operator=(const Shard&) = delete;
+
+    // the inbox's indices sit on their own cache lines, an alignment
+    // plain new does not honour before C++17
+    static void* operator new(size_t bytes);
+    static void operator delete(void* p);
+
+    bool start(std::string &err);
+    void stop(); // parks every game, closing its journal
+
+    // acceptor thread; false when the queue is full
+    bool hand(const Handoff &h);
+
+    // connections, which is what placement balances
+    int load() const { return connections.load(std::memory_order_relaxed); }
+    size_t games() const { return gameCount.load(std::memory_order_relaxed); }
+    size_t liveGames() const { return liveCount.load(std::memory_order_relaxed); }
+    // the last game its only player left before a second joined, so the
+    // acceptor stops sending newcomers there; 0 for none
+    uint64_t deserted() const { return desertedGame.load(std::memory_order_acquire); }
+
+private:
+    struct GameSlot;
+
+    struct LiveGame {
+        explicit LiveGame(const Game &g) : game(g) {}
+        Game game;
+        JournalWriter journal;
+        std::list<GameSlot*>::iterator lru;
+        int64_t lastMs = 0;  // last command
+    };
+
+    struct GameSlot {
+        uint64_t id = 0;
+        std::unique_ptr<LiveGame> live;   // null while parked
+        std::vector<unsigned char> state; // snapshot: as broadcast, and all a parked game keeps
+        std::vector<int> fds;             // players and watchers
+        int seats[2] = {-1, -1};          // fd in each seat
+        uint64_t tokens[2] = {0, 0};      // each seat's rejoin token, 0 until first taken
+        uint32_t stretches = 0;           // times it has been live, names journals
+        bool over = false;
+        int64_t vacantMs = -1;            // since nobody is seated; -1 while someone is
+        std::list<GameSlot*>::iterator vacancy; // in vacant, while vacantMs >= 0
+    };
+
+    struct Client {
+        NetConn conn;
+        GameSlot* game = nullptr;
+        int seat = -1;            // -1 watching
+        bool writable = false;    // EPOLLOUT registered
+    };
+
+    Game proto;
+    uint64_t seed;
+    std::string recordDir;
+    int epfd = -1;
+    int wakeFd = -1;              // eventfd, rung by hand() and stop()
+    std::thread worker;
+    std::atomic<bool> running{false};
+    std::random_device entropy;   // seat tokens; not derived from seed, which dice use
+
+    SpscQueue<Handoff, 1024> inbox;
+    std::atomic<int> connections{0};
+    std::atomic<size_t> gameCount{0}, liveCount{0};
+    std::atomic<uint64_t> desertedGame{0};
+
+    std::unordered_map<uint64_t, GameSlot> slots;
+    std::unordered_map<int, Client> clients; // by fd
+    std::list<GameSlot*> lru;                // live games, least recently played first
+    std::list<GameSlot*> vacant;             // games nobody is seated at, longest first
+
+    void run();
+    void attach(Handoff &h);
+    LiveGame& wake(GameSlot &s);
+    void park(GameSlot &s);
+    void seatsChanged(GameSlot &s, int64_t now);
+    void expire(GameSlot &s);
+    void forget(GameSlot &s);
+    uint64_t newToken();
+    void sweep(int64_t now);
+    void readFrom(Client &c);
+    void command(Client &c, const unsigned char* body, uint32_t len);
+    void send(Client &c, uint8_t type, const void* body, uint32_t len);
+    void flush(Client &c);
+    void drop(int fd);
+};
+
+#endif
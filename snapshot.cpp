@@ -0,0 +1,176 @@
+// snapshot.cpp
+#include "snapshot.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const char     kMagic[8] = {'R','I','S','K','S','A','V','1'};
+const uint32_t kVersion  = 1;
+
+struct SnapshotHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t numTerrs;
+    uint64_t mapFingerprint;
+    uint64_t rngSeed;
+    uint64_t rngCount;
+    int32_t  currentPlayer;
+    int32_t  phase;
+    int32_t  reinforcementsLeft;
+    int32_t  winner;
+    int32_t  attackFrom, attackTo;
+    int32_t  fortFrom, fortTo;
+    uint8_t  gameOver;
+    uint8_t  fortifyDone;
+    uint8_t  pad[6];
+};
+
+} // namespace
+
+size_t snapshotMaxBytes(const Game &g) {
+    // owner byte plus at most 5 varint bytes per territory
+    return sizeof(SnapshotHeader) + g.terrs.size() * 6;
+}
+
+size_t writeSnapshot(const Game &g, unsigned char* out) {
+    SnapshotHeader hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    std::memcpy(hdr.magic, kMagic, sizeof(kMagic));
+    hdr.version            = kVersion;
+    hdr.numTerrs           = (uint32_t)g.terrs.size();
+    hdr.mapFingerprint     = g.map->fingerprint;
+    hdr.rngSeed            = g.rngSeed;
+    hdr.rngCount           = g.rngCount;
+    hdr.currentPlayer      = g.currentPlayer;
+    hdr.phase              = g.phase;
+    hdr.reinforcementsLeft = g.reinforcementsLeft;
+    hdr.winner             = g.winner;
+    hdr.attackFrom         = g.attackSel.fromTerr;
+    hdr.attackTo           = g.attackSel.toTerr;
+    hdr.fortFrom           = g.fortSel.fromTerr;
+    hdr.fortTo             = g.fortSel.toTerr;
+    hdr.gameOver           = g.gameOver ? 1 : 0;
+    hdr.fortifyDone        = g.fortifyDone ? 1 : 0;
+    std::memcpy(out, &hdr, sizeof(hdr));
+
+    size_t n = g.terrs.size();
+    unsigned char* p = out + sizeof(hdr);
+    for (size_t i = 0; i < n; ++i) p[i] = (unsigned char)(g.terrs[i].owner + 1);
+    p += n;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t v = (uint32_t)g.terrs[i].armies;
+        while (v >= 0x80) {
+            *p++ = (unsigned char)(v | 0x80);
+            v >>= 7;
+        }
+        *p++ = (unsigned char)v;
+    }
+    return (size_t)(p - out);
+}
+
+bool readSnapshot(Game &g, const unsigned char* data, size_t len, std::string &err) {
+    SnapshotHeader hdr;
+    if (len < sizeof(hdr)) { err = "truncated snapshot"; return false; }
+    std::memcpy(&hdr, data, sizeof(hdr));
+    if (std::memcmp(hdr.magic, kMagic, sizeof(kMagic)) != 0) { err = "not a snapshot"; return false; }
+    if (hdr.version != kVersion) { err = "unsupported snapshot version"; return false; }
+    if (hdr.numTerrs != g.terrs.size() || hdr.mapFingerprint != g.map->fingerprint) {
+        err = "snapshot is for a different map";
+        return false;
+    }
+    int n = (int)hdr.numTerrs;
+    auto terrOrNone = [n](int32_t t) { return t >= -1 && t < n; };
+    bool ok = (hdr.currentPlayer == 0 || hdr.currentPlayer == 1) &&
+              hdr.phase >= PHASE_REINFORCE && hdr.phase <= PHASE_FORTIFY &&
+              hdr.reinforcementsLeft >= 0 &&
+              hdr.winner >= -1 && hdr.winner <= 1 &&
+              terrOrNone(hdr.attackFrom) && terrOrNone(hdr.attackTo) &&
+              terrOrNone(hdr.fortFrom) && terrOrNone(hdr.fortTo) &&
+              hdr.gameOver <= 1 && hdr.fortifyDone <= 1;
+    if (!ok || len - sizeof(hdr) < (size_t)n) { err = "corrupt snapshot"; return false; }
+
+    // validate the territory data in full, then apply it
+    const unsigned char* owners = data + sizeof(hdr);
+    const unsigned char* armies = owners + n;
+    const unsigned char* end = data + len;
+    const unsigned char* p = armies;
+    for (int i = 0; i < n && ok; ++i) {
+        ok = owners[i] <= 2;
+        int shift = 0;
+        while (ok && p < end && (*p & 0x80)) {
+            ok = shift < 28;
+            ++p;
+            shift += 7;
+        }
+        ok = ok && p < end && (shift < 28 || *p < 0x08); // fits in int32
+        ++p;
+    }
+    if (!ok || p != end) { err = "corrupt snapshot"; return false; }
+
+    p = armies;
+    for (int i = 0; i < n; ++i) {
+        uint32_t v = 0;
+        for (int shift = 0; ; shift += 7) {
+            v |= (uint32_t)(*p & 0x7f) << shift;
+            if (!(*p++ & 0x80)) break;
+        }
+        Territory &t = g.terrs[i];
+        t.owner = (int)owners[i] - 1;
+        t.armies = (int)v;
+        t.capturing = t.reinforcing = false;
+        t.animT = t.reinfT = 0.0f;
+    }
+    g.rngSeed            = hdr.rngSeed;
+    g.rngCount           = hdr.rngCount;
+    g.currentPlayer      = hdr.currentPlayer;
+    g.phase              = (Phase)hdr.phase;
+    g.reinforcementsLeft = hdr.reinforcementsLeft;
+    g.winner             = hdr.winner;
+    g.attackSel.fromTerr = hdr.attackFrom;
+    g.attackSel.toTerr   = hdr.attackTo;
+    g.fortSel.fromTerr   = hdr.fortFrom;
+    g.fortSel.toTerr     = hdr.fortTo;
+    g.gameOver           = hdr.gameOver != 0;
+    g.fortifyDone        = hdr.fortifyDone != 0;
+    g.regions.build(*g.map, g.terrs);
+    g.history.reset(g);
+    return true;
+}
+
+bool saveSnapshot(const Game &g, const char* path, std::string &err) {
+    std::vector<unsigned char> buf(snapshotMaxBytes(g));
+    size_t len = writeSnapshot(g, buf.data());
+
+    // write beside the target and rename, so a crash never leaves half a save
+    std::string tmp = std::string(path) + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    bool ok = f && std::fwrite(buf.data(), 1, len, f) == len;
+    if (f) ok = (std::fclose(f) == 0) && ok;
+    if (ok) ok = std::rename(tmp.c_str(), path) == 0;
+    if (!ok) {
+        std::remove(tmp.c_str());
+        err = std::string(path) + ": cannot write";
+    }
+    return ok;
+}
+
+bool loadSnapshot(Game &g, const char* path, std::string &err) {
+    FILE* f = std::fopen(path, "rb");
+    if (!f) {
+        err = std::string(path) + ": cannot open";
+        return false;
+    }
+    std::vector<unsigned char> buf;
+    unsigned char chunk[65536];
+    size_t got;
+    while ((got = std::fread(chunk, 1, sizeof(chunk), f)) > 0) buf.insert(buf.end(), chunk, chunk + got);
+    std::fclose(f);
+    if (!readSnapshot(g, buf.data(), buf.size(), err)) {
+        err = std::string(path) + ": " + err;
+        return false;
+    }
+    return true;
+}
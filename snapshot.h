@@ -0,0 +1,27 @@
+// snapshot.h
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstddef>
+#include <string>
+#include "game.h"
+
+// Binary game snapshot: a fixed header (version, map fingerprint, turn
+// state, selections, dice stream) followed by one owner byte per
+// territory and the army counts as LEB128 varints. Animation flags are
+// not saved. Snapshots load only into a Game on the same map.
+
+// upper bound on writeSnapshot's output for this game
+size_t snapshotMaxBytes(const Game &g);
+
+// writes into out (at least snapshotMaxBytes long), returns the bytes used
+size_t writeSnapshot(const Game &g, unsigned char* out);
+
+// checks everything before touching g, so a bad snapshot leaves it as it was
+bool readSnapshot(Game &g, const unsigned char* data, size_t len, std::string &err);
+
+// whole files, written beside the target and renamed into place
+bool saveSnapshot(const Game &g, const char* path, std::string &err);
+bool loadSnapshot(Game &g, const char* path, std::string &err);
+
+#endif
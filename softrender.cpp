@@ -0,0 +1,342 @@
+// softrender.cpp
+#include "softrender.h"
+#include "lod.h"
+#include "texcache.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void territoryBaseColor(const Game &game, int terrIdx, bool highlight, float &r, float &g, float &b) {
+    const Territory &t = game.terrs[terrIdx];
+    const float* c = &game.map->colors[3 * terrIdx];
+    r = c[0]; g = c[1]; b = c[2];
+    if (t.owner == 0) { // player1 red-ish
+        r = 1.0f; g *= 0.4f; b *= 0.4f;
+    } else if (t.owner == 1) { // player2 blue-ish
+        r *= 0.4f; g *= 0.4f; b = 1.0f;
+    } else { // neutral gray
+        r = g = b = 0.5f;
+    }
+    if (highlight) {
+        r = std::min(r + 0.3f, 1.0f);
+        g = std::min(g + 0.3f, 1.0f);
+        b = std::min(b + 0.3f, 1.0f);
+    }
+}
+
+namespace {
+
+const int kTileRows   = 32;
+const int kFillAlpha  = 83;  // 0.65 in 1/128ths, as glColor4f(..., 0.65f)
+const int kLineAlpha  = 115; // 0.9
+const unsigned char kClear = 230; // glClearColor 0.9
+
+// 3x5 digits, row-major, top row in the high bits
+const unsigned short kDigits[10] = {
+    0x7B6F, 0x2C97, 0x73E7, 0x73CF, 0x5BC9,
+    0x79CF, 0x79EF, 0x7249, 0x7BEF, 0x7BCF
+};
+
+// one territory in pixel space
+struct PixPoly {
+    int   edgeStart, edgeEnd;  // into the SoA edge arrays
+    int   lineStart, lineEnd;  // outline segments this territory owns
+    int   rowMin, rowMax;      // pixel rows whose centers it may cover
+    unsigned char pattern[48]; // 16 pixels of its fill color
+    int   labelX, labelY;
+    int   armies;
+    bool  label;
+};
+
+struct Scene {
+    int w, h;
+    // edges as SoA; vertex i of an edge is (x0,y0), the other end (x1,y1)
+    std::vector<float> x0, y0, x1, y1, slope;
+    // outline segments, shared borders once
+    std::vector<float> lx0, ly0, lx1, ly1;
+    std::vector<PixPoly> polys;
+    // atlas lookup per column / row, -1 outside the atlas
+    const TexLevel* level = nullptr;
+    std::vector<int> srcCol, srcRow;
+    bool outlines, labels;
+    int  fontScale;
+};
+
+inline unsigned char blend(unsigned char d, unsigned char c, int a7) {
+    return (unsigned char)(d + (((int)c - (int)d) * a7 >> 7));
+}
+
+// dst += (color - dst) * alpha over a run of RGB pixels
+void blendSpan(unsigned char* dst, int pixels, const unsigned char pattern[48], int a7) {
+    int bytes = pixels * 3;
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i av   = _mm_set1_epi16((short)a7);
+    __m128i p[3];
+    __m128i plo[3], phi[3];
+    for (int k = 0; k < 3; ++k) {
+        p[k]   = _mm_loadu_si128((const __m128i*)(pattern + 16*k));
+        plo[k] = _mm_unpacklo_epi8(p[k], zero);
+        phi[k] = _mm_unpackhi_epi8(p[k], zero);
+    }
+    for (; i + 48 <= bytes; i += 48) {
+        for (int k = 0; k < 3; ++k) {
+            __m128i* q = (__m128i*)(dst + i + 16*k);
+            __m128i d   = _mm_loadu_si128(q);
+            __m128i dlo = _mm_unpacklo_epi8(d, zero);
+            __m128i dhi = _mm_unpackhi_epi8(d, zero);
+            dlo = _mm_add_epi16(dlo, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(plo[k], dlo), av), 7));
+            dhi = _mm_add_epi16(dhi, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(phi[k], dhi), av), 7));
+            _mm_storeu_si128(q, _mm_packus_epi16(dlo, dhi));
+        }
+    }
+#endif
+    for (; i < bytes; ++i) dst[i] = blend(dst[i], pattern[i % 48], a7);
+}
+
+void buildScene(const Game &game, const SoftRenderOptions &opt, Scene &sc) {
+    sc.w = opt.width;
+    sc.h = opt.height;
+    sc.outlines = opt.outlines;
+    sc.labels = opt.labels;
+    sc.fontScale = std::max(1, sc.h / 200);
+
+    float sx = opt.camZoom * sc.w * 0.5f;
+    float sy = opt.camZoom * sc.h * 0.5f;
+    auto toPx = [&](float wx, float wy, float &px, float &py) {
+        px = (wx - opt.camX) * sx + sc.w * 0.5f;
+        py = sc.h * 0.5f - (wy - opt.camY) * sy;
+    };
+
+    int lodLevel = 0;
+    if (opt.lod) lodLevel = opt.lod->levelFor(2.0f / (opt.camZoom * (float)std::max(sc.w, sc.h)));
+
+    const MapData &map = *game.map;
+    PolyLod lod;
+    lod.bind(map);
+    std::vector<uint32_t> lines;
+    sc.polys.clear();
+    for (int i = 0; i < (int)game.terrs.size(); ++i) {
+        const Territory &t = game.terrs[i];
+        const float* bb = &map.bounds[4 * i];
+        float bx0, by0, bx1, by1;
+        toPx(bb[0], bb[3], bx0, by0);
+        toPx(bb[2], bb[1], bx1, by1);
+        if (bx1 < 0 || bx0 > sc.w || by1 < 0 || by0 > sc.h) continue;
+
+        int n;
+        const uint32_t* ring = lod.ring(lodLevel, i, n);
+        if (n == 0) continue; // folded away at this level
+
+        // rows from the ring as drawn; snapping at coarse levels can move
+        // it a little outside the territory's bounds
+        PixPoly pp;
+        pp.edgeStart = (int)sc.x0.size();
+        float ry0 = (float)sc.h, ry1 = 0.0f;
+        for (int k = 0; k < n; ++k) {
+            uint32_t a = map.edgeFrom(ring[k]), b = map.edgeFrom(ring[(k+1) % n]);
+            float ax, ay, bx, by;
+            toPx(map.verts[2*a], map.verts[2*a+1], ax, ay);
+            toPx(map.verts[2*b], map.verts[2*b+1], bx, by);
+            sc.x0.push_back(ax); sc.y0.push_back(ay);
+            sc.x1.push_back(bx); sc.y1.push_back(by);
+            sc.slope.push_back(by != ay ? (bx - ax) / (by - ay) : 0.0f);
+            ry0 = std::min(ry0, ay);
+            ry1 = std::max(ry1, ay);
+        }
+        pp.edgeEnd = (int)sc.x0.size();
+
+        pp.lineStart = (int)sc.lx0.size();
+        lines.clear();
+        lod.appendLines(lodLevel, i, lines);
+        for (size_t k = 0; k < lines.size(); k += 2) {
+            uint32_t a = lines[k], b = lines[k+1];
+            float ax, ay, bx, by;
+            toPx(map.verts[2*a], map.verts[2*a+1], ax, ay);
+            toPx(map.verts[2*b], map.verts[2*b+1], bx, by);
+            sc.lx0.push_back(ax); sc.ly0.push_back(ay);
+            sc.lx1.push_back(bx); sc.ly1.push_back(by);
+        }
+        pp.lineEnd = (int)sc.lx0.size();
+        pp.rowMin = std::max(0, (int)std::ceil(ry0 - 0.5f));
+        pp.rowMax = std::min(sc.h - 1, (int)std::floor(ry1 - 0.5f));
+
+        bool hl = (game.phase == PHASE_ATTACK  && i == game.attackSel.fromTerr) ||
+                  (game.phase == PHASE_FORTIFY && i == game.fortSel.fromTerr);
+        float r, g, b;
+        territoryBaseColor(game, i, hl, r, g, b);
+        unsigned char rgb[3] = {(unsigned char)(r*255.0f + 0.5f),
+                                (unsigned char)(g*255.0f + 0.5f),
+                                (unsigned char)(b*255.0f + 0.5f)};
+        for (int k = 0; k < 48; ++k) pp.pattern[k] = rgb[k % 3];
+
+        float lx, ly;
+        toPx(map.labels[2*i], map.labels[2*i+1], lx, ly);
+        pp.labelX = (int)lx;
+        pp.labelY = (int)ly;
+        pp.armies = t.armies;
+        // same rule as the client: no counts on territories under 12 pixels
+        pp.label = (bx1 - bx0) >= 12.0f || (by1 - by0) >= 12.0f;
+        sc.polys.push_back(pp);
+    }
+
+    // background: the smallest mip level still at least as wide as the atlas on screen
+    sc.level = nullptr;
+    if (opt.atlas && !opt.atlas->levels.empty()) {
+        float onScreenW = opt.camZoom * sc.w;
+        sc.level = &opt.atlas->levels[0];
+        for (const TexLevel &lv : opt.atlas->levels) {
+            if ((float)lv.w >= onScreenW) sc.level = &lv;
+        }
+        sc.srcCol.resize(sc.w);
+        sc.srcRow.resize(sc.h);
+        for (int x = 0; x < sc.w; ++x) {
+            float wx = ((x + 0.5f) - sc.w * 0.5f) / sx + opt.camX;
+            float u = (wx + 1.0f) * 0.5f;
+            sc.srcCol[x] = (u < 0.0f || u >= 1.0f) ? -1 : std::min(sc.level->w - 1, (int)(u * sc.level->w));
+        }
+        for (int y = 0; y < sc.h; ++y) {
+            float wy = (sc.h * 0.5f - (y + 0.5f)) / sy + opt.camY;
+            float v = (1.0f - wy) * 0.5f;
+            sc.srcRow[y] = (v < 0.0f || v >= 1.0f) ? -1 : std::min(sc.level->h - 1, (int)(v * sc.level->h));
+        }
+    }
+}
+
+void plot(const Scene &sc, Image &out, int x, int y, int r0, int r1, int a7) {
+    if (x < 0 || x >= sc.w || y < r0 || y >= r1) return;
+    unsigned char* p = &out.rgb[((size_t)y * sc.w + x) * 3];
+    p[0] = blend(p[0], 0, a7);
+    p[1] = blend(p[1], 0, a7);
+    p[2] = blend(p[2], 0, a7);
+}
+
+void renderTile(const Scene &sc, Image &out, int r0, int r1, std::vector<float> &xs) {
+    // background
+    for (int y = r0; y < r1; ++y) {
+        unsigned char* row = &out.rgb[(size_t)y * sc.w * 3];
+        int sr = sc.level ? sc.srcRow[y] : -1;
+        if (sr < 0) {
+            std::fill(row, row + sc.w * 3, kClear);
+            continue;
+        }
+        const unsigned char* src = sc.level->pixels + (size_t)sr * sc.level->w * 3;
+        for (int x = 0; x < sc.w; ++x) {
+            int sc0 = sc.srcCol[x];
+            if (sc0 < 0) {
+                row[x*3] = row[x*3+1] = row[x*3+2] = kClear;
+            } else {
+                row[x*3]   = src[sc0*3];
+                row[x*3+1] = src[sc0*3+1];
+                row[x*3+2] = src[sc0*3+2];
+            }
+        }
+    }
+
+    // territory fills: even-odd spans per scanline, in draw order
+    for (const PixPoly &pp : sc.polys) {
+        int ya = std::max(r0, pp.rowMin), yb = std::min(r1 - 1, pp.rowMax);
+        for (int y = ya; y <= yb; ++y) {
+            float yc = y + 0.5f;
+            xs.clear();
+            for (int e = pp.edgeStart; e < pp.edgeEnd; ++e) {
+                if ((sc.y0[e] <= yc) != (sc.y1[e] <= yc)) {
+                    xs.push_back(sc.x0[e] + (yc - sc.y0[e]) * sc.slope[e]);
+                }
+            }
+            std::sort(xs.begin(), xs.end());
+            unsigned char* row = &out.rgb[(size_t)y * sc.w * 3];
+            for (size_t k = 0; k + 1 < xs.size(); k += 2) {
+                int xa = std::max(0,    (int)std::ceil(xs[k]   - 0.5f));
+                int xb = std::min(sc.w, (int)std::ceil(xs[k+1] - 0.5f));
+                if (xb > xa) blendSpan(row + xa*3, xb - xa, pp.pattern, kFillAlpha);
+            }
+        }
+    }
+
+    // outlines, clipped to this tile's rows
+    if (sc.outlines) {
+        for (const PixPoly &pp : sc.polys) {
+            if (pp.rowMax + 1 < r0 || pp.rowMin - 1 >= r1) continue;
+            for (int e = pp.lineStart; e < pp.lineEnd; ++e) {
+                float ax = sc.lx0[e], ay = sc.ly0[e], bx = sc.lx1[e], by = sc.ly1[e];
+                if (std::max(ay, by) < r0 || std::min(ay, by) >= r1) continue;
+                float dx = bx - ax, dy = by - ay;
+                int steps = (int)std::ceil(std::max(std::fabs(dx), std::fabs(dy)));
+                if (steps == 0) {
+                    plot(sc, out, (int)ax, (int)ay, r0, r1, kLineAlpha);
+                    continue;
+                }
+                float ix = dx / steps, iy = dy / steps;
+                for (int s = 0; s <= steps; ++s) {
+                    plot(sc, out, (int)(ax + ix*s), (int)(ay + iy*s), r0, r1, kLineAlpha);
+                }
+            }
+        }
+    }
+
+    // army counts, anchored bottom-left at the label point like glRasterPos
+    if (sc.labels) {
+        int fs = sc.fontScale;
+        for (const PixPoly &pp : sc.polys) {
+            if (!pp.label) continue;
+            int top = pp.labelY - 5*fs;
+            if (pp.labelY < r0 || top >= r1) continue;
+            char buf[16];
+            int len = std::snprintf(buf, sizeof(buf), "%d", pp.armies);
+            for (int c = 0; c < len; ++c) {
+                if (buf[c] < '0' || buf[c] > '9') continue;
+                unsigned short glyph = kDigits[buf[c] - '0'];
+                int gx = pp.labelX + c * 4 * fs;
+                for (int gy = 0; gy < 5; ++gy)
+                    for (int gxo = 0; gxo < 3; ++gxo) {
+                        if (!(glyph & (1 << (14 - gy*3 - gxo)))) continue;
+                        for (int sy = 0; sy < fs; ++sy)
+                            for (int sx = 0; sx < fs; ++sx)
+                                plot(sc, out, gx + gxo*fs + sx, top + gy*fs + sy, r0, r1, 128);
+                    }
+            }
+        }
+    }
+}
+
+} // namespace
+
+void renderGame(const Game &game, const SoftRenderOptions &opt, Image &out) {
+    Scene sc;
+    buildScene(game, opt, sc);
+    out.w = sc.w;
+    out.h = sc.h;
+    out.rgb.resize((size_t)sc.w * sc.h * 3);
+
+    // tiles are row bands, handed out to threads first-come first-served
+    int numTiles = (sc.h + kTileRows - 1) / kTileRows;
+    std::atomic<int> nextTile(0);
+    auto worker = [&]() {
+        std::vector<float> xs;
+        for (int tile; (tile = nextTile.fetch_add(1)) < numTiles; ) {
+            int r0 = tile * kTileRows;
+            renderTile(sc, out, r0, std::min(sc.h, r0 + kTileRows), xs);
+        }
+    };
+
+    int numThreads = std::max(1, std::min(opt.threads, numTiles));
+    std::vector<std::thread> pool;
+    for (int i = 1; i < numThreads; ++i) pool.emplace_back(worker);
+    worker();
+    for (auto &th : pool) th.join();
+}
+
+bool writePPM(const Image &img, const char* path) {
+    FILE* f = std::fopen(path, "wb");
+    if (!f) return false;
+    std::fprintf(f, "P6\n%d %d\n255\n", img.w, img.h);
+    bool ok = std::fwrite(img.rgb.data(), 1, img.rgb.size(), f) == img.rgb.size();
+    return (std::fclose(f) == 0) && ok;
+}
@@ -0,0 +1,37 @@
+// softrender.h
+#ifndef SOFTRENDER_H
+#define SOFTRENDER_H
+
+#include <vector>
+#include "game.h"
+
+class TexCache;
+class PolyLod;
+
+// tightly packed RGB, row 0 at the top
+struct Image {
+    int w = 0, h = 0;
+    std::vector<unsigned char> rgb;
+};
+
+struct SoftRenderOptions {
+    int   width  = 256;
+    int   height = 128;
+    float camX = 0.0f, camY = 0.0f, camZoom = 1.0f; // same camera as the client
+    int   threads = 1;          // tiles are shared out across this many threads
+    bool  outlines = true;
+    bool  labels   = true;
+    const TexCache* atlas = nullptr; // background, nearest mip level is sampled
+    const PolyLod*  lod   = nullptr; // simplified rings when given
+};
+
+// Draws a game state without any GL context: atlas background, owner-tinted
+// territories, outlines and army counts, matching what displayCB shows.
+void renderGame(const Game &game, const SoftRenderOptions &opt, Image &out);
+
+bool writePPM(const Image &img, const char* path);
+
+// fill color displayCB and the software renderer share
+void territoryBaseColor(const Game &game, int terrIdx, bool highlight, float &r, float &g, float &b);
+
+#endif
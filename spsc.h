@@ -0,0 +1,72 @@
+// spsc.h
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free ring buffer for exactly one producer thread and one
+// consumer thread. Capacity must be a power of two; push fails when full.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+public:
+    bool push(const T &v) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == Capacity) return false;
+        slots[h & (Capacity - 1)] = v;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &v) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false;
+        v = slots[t & (Capacity - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+    }
+
+private:
+    T slots[Capacity];
+    // producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+// Lock-free triple buffer: one writer publishes whole values, one reader
+// always gets the latest complete one. Neither side ever waits; values the
+// reader never picked up are simply overwritten.
+template <typename T>
+class TripleBuffer {
+public:
+    T& writeBuffer() { return slots[back]; }
+
+    void publish() {
+        back = middle.exchange(back | kFresh, std::memory_order_acq_rel) & kIndex;
+    }
+
+    // swap in the newest published value; false if nothing new
+    bool update() {
+        if (!(middle.load(std::memory_order_relaxed) & kFresh)) return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & kIndex;
+        return true;
+    }
+
+    const T& readBuffer() const { return slots[front]; }
+
+private:
+    static const int kIndex = 3;
+    static const int kFresh = 4;
+
+    T slots[3];
+    int back = 0;   // writer only
+    int front = 1;  // reader only
+    std::atomic<int> middle{2};
+};
+
+#endif
@@ -0,0 +1,204 @@
+// texcache.cpp
+#include "texcache.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char     kMagic[8] = {'R','I','S','K','T','E','X','1'};
+const uint32_t kVersion  = 1;
+
+struct CacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t numLevels;
+    int64_t  srcSize;   // stamp of the image the cache was built from
+    int64_t  srcMtime;  // nanoseconds
+};
+
+struct CacheLevel {
+    uint32_t w, h;
+    uint64_t offset;    // from start of file
+};
+
+bool statFile(const char* path, long long &size, long long &mtime) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    size  = (long long)st.st_size;
+    mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    return true;
+}
+
+// 2x2 box filter, edge pixels clamped for odd sizes
+void downsample(const unsigned char* src, int sw, int sh,
+                unsigned char* dst, int dw, int dh) {
+    for (int y = 0; y < dh; ++y) {
+        int y0 = std::min(2*y,   sh-1);
+        int y1 = std::min(2*y+1, sh-1);
+        const unsigned char* r0 = src + (size_t)y0 * sw * 3;
+        const unsigned char* r1 = src + (size_t)y1 * sw * 3;
+        unsigned char* out = dst + (size_t)y * dw * 3;
+        for (int x = 0; x < dw; ++x) {
+            int x0 = std::min(2*x,   sw-1) * 3;
+            int x1 = std::min(2*x+1, sw-1) * 3;
+            for (int c = 0; c < 3; ++c) {
+                int s = r0[x0+c] + r0[x1+c] + r1[x0+c] + r1[x1+c];
+                out[x*3+c] = (unsigned char)((s + 2) >> 2);
+            }
+        }
+    }
+}
+
+} // namespace
+
+std::string texCachePath(const char* imagePath) {
+    return std::string(imagePath) + ".texcache";
+}
+
+TexCache::~TexCache() {
+    release();
+}
+
+void TexCache::release() {
+    if (mapped) munmap(mapped, mappedLen);
+    mapped = nullptr;
+    mappedLen = 0;
+    owned.clear();
+    owned.shrink_to_fit();
+    levels.clear();
+}
+
+bool TexCache::load(const char* imagePath) {
+    release();
+
+    long long srcSize = -1, srcMtime = -1;
+    bool haveSrc = statFile(imagePath, srcSize, srcMtime);
+    std::string cachePath = texCachePath(imagePath);
+
+    // missing source: a cache is still better than nothing
+    if (mapCache(cachePath, haveSrc ? srcSize : -1, haveSrc ? srcMtime : -1)) {
+        fromCache = true;
+        return true;
+    }
+    if (!haveSrc || !decodeAndBuild(imagePath)) return false;
+    fromCache = false;
+
+    if (!writeCache(cachePath, srcSize, srcMtime)) {
+        std::fprintf(stderr, "WARNING: could not write %s\n", cachePath.c_str());
+    }
+    return true;
+}
+
+bool TexCache::mapCache(const std::string& path, long long srcSize, long long srcMtime) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CacheHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t len = (size_t)st.st_size;
+    void* base = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return false;
+
+    const unsigned char* bytes = (const unsigned char*)base;
+    CacheHeader hdr;
+    std::memcpy(&hdr, bytes, sizeof(hdr));
+
+    bool ok = std::memcmp(hdr.magic, kMagic, sizeof(kMagic)) == 0 &&
+              hdr.version == kVersion &&
+              hdr.numLevels > 0 && hdr.numLevels <= 32 &&
+              sizeof(CacheHeader) + hdr.numLevels * sizeof(CacheLevel) <= len;
+    // stale when the image was replaced or touched
+    if (ok && srcSize >= 0) ok = hdr.srcSize == srcSize && hdr.srcMtime == srcMtime;
+
+    const CacheLevel* table = (const CacheLevel*)(bytes + sizeof(CacheHeader));
+    for (uint32_t i = 0; ok && i < hdr.numLevels; ++i) {
+        uint64_t need = (uint64_t)table[i].w * table[i].h * 3;
+        ok = table[i].w > 0 && table[i].h > 0 &&
+             table[i].offset <= len && need <= len - table[i].offset;
+        if (ok) levels.push_back({(int)table[i].w, (int)table[i].h, bytes + table[i].offset});
+    }
+
+    if (!ok) {
+        levels.clear();
+        munmap(base, len);
+        return false;
+    }
+    mapped = base;
+    mappedLen = len;
+    return true;
+}
+
+bool TexCache::decodeAndBuild(const char* imagePath) {
+    int w, h, nChannels;
+    unsigned char* data = stbi_load(imagePath, &w, &h, &nChannels, 3);
+    if (!data) return false;
+
+    // size the whole chain first so the level pointers stay valid
+    std::vector<std::pair<int,int>> dims;
+    size_t total = 0;
+    for (int lw = w, lh = h; ; lw = std::max(1, lw/2), lh = std::max(1, lh/2)) {
+        dims.push_back({lw, lh});
+        total += (size_t)lw * lh * 3;
+        if (lw == 1 && lh == 1) break;
+    }
+
+    owned.resize(total);
+    std::memcpy(owned.data(), data, (size_t)w * h * 3);
+    stbi_image_free(data);
+
+    size_t off = 0;
+    for (size_t i = 0; i < dims.size(); ++i) {
+        unsigned char* px = owned.data() + off;
+        if (i > 0) {
+            const TexLevel &prev = levels.back();
+            downsample(prev.pixels, prev.w, prev.h, px, dims[i].first, dims[i].second);
+        }
+        levels.push_back({dims[i].first, dims[i].second, px});
+        off += (size_t)dims[i].first * dims[i].second * 3;
+    }
+    return true;
+}
+
+bool TexCache::writeCache(const std::string& path, long long srcSize, long long srcMtime) const {
+    CacheHeader hdr;
+    std::memcpy(hdr.magic, kMagic, sizeof(kMagic));
+    hdr.version   = kVersion;
+    hdr.numLevels = (uint32_t)levels.size();
+    hdr.srcSize   = srcSize;
+    hdr.srcMtime  = srcMtime;
+
+    std::vector<CacheLevel> table(levels.size());
+    uint64_t off = sizeof(CacheHeader) + table.size() * sizeof(CacheLevel);
+    for (size_t i = 0; i < levels.size(); ++i) {
+        table[i].w = (uint32_t)levels[i].w;
+        table[i].h = (uint32_t)levels[i].h;
+        table[i].offset = off;
+        off += (uint64_t)levels[i].w * levels[i].h * 3;
+    }
+
+    // write beside the target and rename, so a crash never leaves half a cache
+    std::string tmp = path + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = std::fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+              std::fwrite(table.data(), sizeof(CacheLevel), table.size(), f) == table.size();
+    for (size_t i = 0; ok && i < levels.size(); ++i) {
+        size_t n = (size_t)levels[i].w * levels[i].h * 3;
+        ok = std::fwrite(levels[i].pixels, 1, n, f) == n;
+    }
+    ok = (std::fclose(f) == 0) && ok;
+    if (ok) ok = std::rename(tmp.c_str(), path.c_str()) == 0;
+    if (!ok) std::remove(tmp.c_str());
+    return ok;
+}
@@ -0,0 +1,43 @@
+// texcache.h
+#ifndef TEXCACHE_H
+#define TEXCACHE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// one mip level, tightly packed RGB rows (upload with GL_UNPACK_ALIGNMENT 1)
+struct TexLevel {
+    int w, h;
+    const unsigned char* pixels;
+};
+
+// World texture with its full mip chain in upload format.
+// load() maps "<image>.texcache" when it is newer than the image,
+// otherwise decodes the image, builds the mips and rewrites the cache.
+class TexCache {
+public:
+    TexCache() = default;
+    ~TexCache();
+    TexCache(const TexCache&) = delete;
+    TexCache& operator=(const TexCache&) = delete;
+
+    bool load(const char* imagePath);
+    void release(); // drop pixels once uploaded
+
+    std::vector<TexLevel> levels; // level 0 = full size
+    bool fromCache = false;
+
+private:
+    void*  mapped = nullptr;
+    size_t mappedLen = 0;
+    std::vector<unsigned char> owned;
+
+    bool mapCache(const std::string& path, long long srcSize, long long srcMtime);
+    bool decodeAndBuild(const char* imagePath);
+    bool writeCache(const std::string& path, long long srcSize, long long srcMtime) const;
+};
+
+std::string texCachePath(const char* imagePath);
+
+#endif
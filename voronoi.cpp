@@ -0,0 +1,333 @@
+// voronoi.cpp
+#include "voronoi.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+const MapGenPreset kMapGenPresets[] = {
+    {"tiny",   100,     3},
+    {"small",  1000,    2},
+    {"medium", 10000,   2},
+    {"large",  100000,  1},
+    {"huge",   1000000, 1},
+};
+const int kNumMapGenPresets = sizeof(kMapGenPresets) / sizeof(kMapGenPresets[0]);
+
+const MapGenPreset* findMapGenPreset(const char* name) {
+    for (int i = 0; i < kNumMapGenPresets; ++i) {
+        if (std::strcmp(kMapGenPresets[i].name, name) == 0) return &kMapGenPresets[i];
+    }
+    return nullptr;
+}
+
+namespace {
+
+// fixed generator and conversion, so maps do not depend on the standard
+// library's distributions
+struct SplitMix64 {
+    uint64_t s;
+    uint64_t next() {
+        uint64_t z = (s += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    double uniform() { return (double)(next() >> 11) * (1.0 / 9007199254740992.0); } // [0,1)
+};
+
+// edge tags: >= 0 is the bisector with that seed, otherwise a domain side
+const int kLeft = -1, kRight = -2, kBottom = -3, kTop = -4;
+
+struct CellVert {
+    double x, y;
+    int tag; // edge from this vertex to the next one
+};
+
+struct Seeds {
+    std::vector<double> x, y;
+    // binned as CSR for the neighbor search
+    int g = 1;
+    double binSize = 2.0;
+    std::vector<uint32_t> binStart, binItems;
+
+    void rebin() {
+        int n = (int)x.size();
+        binStart.assign((size_t)g * g + 1, 0);
+        binItems.resize(n);
+        std::vector<int> bin(n);
+        for (int i = 0; i < n; ++i) {
+            int bx = std::min(g - 1, std::max(0, (int)((x[i] + 1.0) / binSize)));
+            int by = std::min(g - 1, std::max(0, (int)((y[i] + 1.0) / binSize)));
+            bin[i] = by * g + bx;
+            binStart[bin[i] + 1]++;
+        }
+        for (size_t b = 1; b < binStart.size(); ++b) binStart[b] += binStart[b-1];
+        std::vector<uint32_t> fill(binStart.begin(), binStart.end() - 1);
+        for (int i = 0; i < n; ++i) binItems[fill[bin[i]]++] = (uint32_t)i;
+    }
+};
+
+// keep the side of the bisector nearer seed i
+void clip(std::vector<CellVert> &poly, std::vector<CellVert> &tmp, const Seeds &s, int i, int j) {
+    double dx = s.x[j] - s.x[i], dy = s.y[j] - s.y[i];
+    double c = 0.5 * (s.x[j]*s.x[j] + s.y[j]*s.y[j] - s.x[i]*s.x[i] - s.y[i]*s.y[i]);
+    size_t n = poly.size();
+    bool anyOut = false;
+    for (size_t k = 0; k < n && !anyOut; ++k) anyOut = poly[k].x*dx + poly[k].y*dy > c;
+    if (!anyOut) return;
+
+    tmp.clear();
+    for (size_t k = 0; k < n; ++k) {
+        const CellVert &a = poly[k];
+        const CellVert &b = poly[(k + 1) % n];
+        double da = a.x*dx + a.y*dy - c;
+        double db = b.x*dx + b.y*dy - c;
+        if (da <= 0.0) tmp.push_back(a);
+        if ((da <= 0.0) != (db <= 0.0)) {
+            double t = da / (da - db);
+            CellVert m = {a.x + t * (b.x - a.x), a.y + t * (b.y - a.y), da <= 0.0 ? j : a.tag};
+            tmp.push_back(m);
+        }
+    }
+    poly.swap(tmp);
+}
+
+// the point where edges ta and tb of cell i meet, computed from the seeds
+// in a fixed order so all cells sharing it get the same bits
+void canonicalVertex(const Seeds &s, int i, int ta, int tb, double &x, double &y) {
+    if (ta < 0 && tb < 0) { // domain corner
+        x = (ta == kRight || tb == kRight) ? 1.0 : -1.0;
+        y = (ta == kTop || tb == kTop) ? 1.0 : -1.0;
+        return;
+    }
+    if (ta < 0 || tb < 0) { // bisector meets a domain side
+        int side = ta < 0 ? ta : tb;
+        int j = ta < 0 ? tb : ta;
+        int a = std::min(i, j), b = std::max(i, j);
+        double dx = s.x[b] - s.x[a], dy = s.y[b] - s.y[a];
+        double c = 0.5 * (s.x[b]*s.x[b] + s.y[b]*s.y[b] - s.x[a]*s.x[a] - s.y[a]*s.y[a]);
+        if (side == kLeft || side == kRight) {
+            x = side == kLeft ? -1.0 : 1.0;
+            y = dy != 0.0 ? (c - x * dx) / dy : 0.0;
+        } else {
+            y = side == kBottom ? -1.0 : 1.0;
+            x = dx != 0.0 ? (c - y * dy) / dx : 0.0;
+        }
+        return;
+    }
+    // circumcentre of the three seeds
+    int v[3] = {i, ta, tb};
+    std::sort(v, v + 3);
+    double ax = s.x[v[0]], ay = s.y[v[0]];
+    double bx = s.x[v[1]] - ax, by = s.y[v[1]] - ay;
+    double cx = s.x[v[2]] - ax, cy = s.y[v[2]] - ay;
+    double d = 2.0 * (bx * cy - by * cx);
+    double b2 = bx*bx + by*by, c2 = cx*cx + cy*cy;
+    x = ax + (cy * b2 - by * c2) / d;
+    y = ay + (bx * c2 - cx * b2) / d;
+}
+
+// Voronoi cell of seed i: clip the domain by bisectors ring by ring until
+// no seed further out could reach the cell
+void computeCell(const Seeds &s, int i, std::vector<CellVert> &poly, std::vector<CellVert> &tmp) {
+    poly.clear();
+    poly.push_back({-1.0, -1.0, kBottom});
+    poly.push_back({ 1.0, -1.0, kRight});
+    poly.push_back({ 1.0,  1.0, kTop});
+    poly.push_back({-1.0,  1.0, kLeft});
+
+    int g = s.g;
+    int bx = std::min(g - 1, std::max(0, (int)((s.x[i] + 1.0) / s.binSize)));
+    int by = std::min(g - 1, std::max(0, (int)((s.y[i] + 1.0) / s.binSize)));
+    for (int ring = 0; ring < g; ++ring) {
+        for (int y = by - ring; y <= by + ring; ++y) {
+            if (y < 0 || y >= g) continue;
+            bool edgeRow = (y == by - ring || y == by + ring);
+            for (int x = bx - ring; x <= bx + ring; x += edgeRow ? 1 : 2 * ring) {
+                if (x >= 0 && x < g) {
+                    int b = y * g + x;
+                    for (uint32_t k = s.binStart[b]; k < s.binStart[b+1]; ++k) {
+                        if ((int)s.binItems[k] != i) clip(poly, tmp, s, i, (int)s.binItems[k]);
+                    }
+                }
+                if (ring == 0) break; // step would be 0
+            }
+        }
+
+        // nothing beyond the searched square is nearer than dmin, so its
+        // bisector stays further than dmin/2 from seed i
+        double r2 = 0.0;
+        for (const CellVert &v : poly) {
+            double dx = v.x - s.x[i], dy = v.y - s.y[i];
+            r2 = std::max(r2, dx*dx + dy*dy);
+        }
+        double dmin = 1e30;
+        if (bx - ring > 0)     dmin = std::min(dmin, s.x[i] - (-1.0 + (bx - ring) * s.binSize));
+        if (bx + ring < g - 1) dmin = std::min(dmin, -1.0 + (bx + ring + 1) * s.binSize - s.x[i]);
+        if (by - ring > 0)     dmin = std::min(dmin, s.y[i] - (-1.0 + (by - ring) * s.binSize));
+        if (by + ring < g - 1) dmin = std::min(dmin, -1.0 + (by + ring + 1) * s.binSize - s.y[i]);
+        if (4.0 * r2 <= dmin * dmin) break;
+    }
+}
+
+void centroid(const std::vector<CellVert> &poly, double &cx, double &cy) {
+    double a = 0.0, sx = 0.0, sy = 0.0;
+    size_t n = poly.size();
+    for (size_t k = 0; k < n; ++k) {
+        const CellVert &p = poly[k], &q = poly[(k + 1) % n];
+        double cr = p.x * q.y - q.x * p.y;
+        a += cr;
+        sx += (p.x + q.x) * cr;
+        sy += (p.y + q.y) * cr;
+    }
+    if (std::fabs(a) < 1e-300) return;
+    cx = sx / (3.0 * a);
+    cy = sy / (3.0 * a);
+}
+
+void hsvToRgb(float h, float s, float v, float &r, float &g, float &b) {
+    float h6 = (h - std::floor(h)) * 6.0f;
+    int k = (int)h6;
+    float f = h6 - k;
+    float p = v * (1 - s), q = v * (1 - s * f), t = v * (1 - s * (1 - f));
+    switch (k % 6) {
+        case 0: r = v; g = t; b = p; break;
+        case 1: r = q; g = v; b = p; break;
+        case 2: r = p; g = v; b = t; break;
+        case 3: r = p; g = q; b = v; break;
+        case 4: r = t; g = p; b = v; break;
+        default: r = v; g = p; b = q; break;
+    }
+}
+
+} // namespace
+
+void generateVoronoiMap(const MapGenOptions &opt, MapSource &out) {
+    int n = std::max(2, opt.territories);
+    SplitMix64 rng{opt.seed};
+
+    // jittered grid: n of the g*g strata, chosen at random, one seed each;
+    // kept in row order so nearby territories get nearby indices
+    Seeds s;
+    s.g = (int)std::ceil(std::sqrt((double)n));
+    s.binSize = 2.0 / s.g;
+    std::vector<uint32_t> strata((size_t)s.g * s.g);
+    for (size_t k = 0; k < strata.size(); ++k) strata[k] = (uint32_t)k;
+    for (int k = 0; k < n; ++k) {
+        size_t pick = k + (size_t)(rng.uniform() * (strata.size() - k));
+        std::swap(strata[k], strata[pick]);
+    }
+    std::sort(strata.begin(), strata.begin() + n);
+    s.x.resize(n);
+    s.y.resize(n);
+    for (int k = 0; k < n; ++k) {
+        int cx = (int)(strata[k] % s.g), cy = (int)(strata[k] / s.g);
+        s.x[k] = -1.0 + (cx + 0.1 + 0.8 * rng.uniform()) * s.binSize;
+        s.y[k] = -1.0 + (cy + 0.1 + 0.8 * rng.uniform()) * s.binSize;
+    }
+
+    std::vector<CellVert> poly, tmp;
+    for (int it = 0; it < opt.lloydIterations; ++it) {
+        s.rebin();
+        std::vector<double> nx(s.x), ny(s.y);
+        for (int i = 0; i < n; ++i) {
+            computeCell(s, i, poly, tmp);
+            centroid(poly, nx[i], ny[i]);
+        }
+        s.x.swap(nx);
+        s.y.swap(ny);
+    }
+    s.rebin();
+
+    out.name = "voronoi_" + std::to_string(n) + "_" + std::to_string(opt.seed);
+    out.terrs.assign(n, TerritorySource());
+    std::vector<std::pair<uint32_t,uint32_t>> links;
+    for (int i = 0; i < n; ++i) {
+        computeCell(s, i, poly, tmp);
+        TerritorySource &t = out.terrs[i];
+        t.name = "t" + std::to_string(i);
+
+        size_t m = poly.size();
+        for (size_t k = 0; k < m; ++k) {
+            double x, y;
+            canonicalVertex(s, i, poly[(k + m - 1) % m].tag, poly[k].tag, x, y);
+            float fx = (float)x, fy = (float)y;
+            // a vertex landing on the previous one drops a zero-length edge
+            if (!t.polyX.empty() && fx == t.polyX.back() && fy == t.polyY.back()) continue;
+            t.polyX.push_back(fx);
+            t.polyY.push_back(fy);
+        }
+        while (t.polyX.size() > 1 && t.polyX.front() == t.polyX.back() && t.polyY.front() == t.polyY.back()) {
+            t.polyX.pop_back();
+            t.polyY.pop_back();
+        }
+
+        for (const CellVert &v : poly) {
+            if (v.tag >= 0) links.push_back({(uint32_t)std::min(i, v.tag), (uint32_t)std::max(i, v.tag)});
+        }
+
+        double lx = s.x[i], ly = s.y[i];
+        centroid(poly, lx, ly);
+        t.labelX = (float)lx;
+        t.labelY = (float)ly;
+    }
+
+    // a border that rounds away on one side still counts for both
+    std::sort(links.begin(), links.end());
+    links.erase(std::unique(links.begin(), links.end()), links.end());
+    for (const std::pair<uint32_t,uint32_t> &l : links) {
+        out.terrs[l.first].neighbors.push_back((int)l.second);
+        out.terrs[l.second].neighbors.push_back((int)l.first);
+    }
+    for (TerritorySource &t : out.terrs) std::sort(t.neighbors.begin(), t.neighbors.end());
+
+    // continents: breadth-first growth from random capitals, round-robin
+    // one ring at a time so they end up comparable in size
+    int k = opt.continents > 0 ? opt.continents
+                               : std::max(2, (int)std::lround(std::sqrt((double)n) / 3.0));
+    k = std::min(k, n);
+    std::vector<int> cont(n, -1);
+    std::vector<std::vector<int>> frontier(k);
+    for (int c = 0; c < k; ++c) {
+        int capital;
+        do { capital = (int)(rng.uniform() * n); } while (cont[capital] >= 0);
+        cont[capital] = c;
+        frontier[c].push_back(capital);
+    }
+    std::vector<int> next;
+    for (bool grew = true; grew; ) {
+        grew = false;
+        for (int c = 0; c < k; ++c) {
+            next.clear();
+            for (int t : frontier[c]) {
+                for (int nb : out.terrs[t].neighbors) {
+                    if (cont[nb] >= 0) continue;
+                    cont[nb] = c;
+                    next.push_back(nb);
+                }
+            }
+            frontier[c].swap(next);
+            grew |= !frontier[c].empty();
+        }
+    }
+
+    std::vector<int> size(k, 0);
+    for (int i = 0; i < n; ++i) {
+        if (cont[i] < 0) cont[i] = 0; // unreachable island, rare
+        size[cont[i]]++;
+    }
+    out.continents.resize(k);
+    for (int c = 0; c < k; ++c) {
+        out.continents[c].name = "c" + std::to_string(c);
+        out.continents[c].bonus = std::max(1, size[c] / 3);
+    }
+
+    // one hue per continent, a little shade variation per territory
+    for (int i = 0; i < n; ++i) {
+        TerritorySource &t = out.terrs[i];
+        t.continent = cont[i];
+        float v = 0.75f + 0.2f * (float)rng.uniform();
+        hsvToRgb(cont[i] * 0.618034f, 0.45f, v, t.r, t.g, t.b);
+    }
+}
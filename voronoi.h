@@ -0,0 +1,34 @@
+// voronoi.h
+#ifndef VORONOI_H
+#define VORONOI_H
+
+#include <cstdint>
+#include "map.h"
+
+struct MapGenOptions {
+    int      territories = 1000;
+    uint64_t seed = 1;
+    int      lloydIterations = 2; // relaxation passes before the final cells
+    int      continents = 0;      // 0 picks about sqrt(territories)/3
+};
+
+// named benchmark scenes for risk_mapgen
+struct MapGenPreset {
+    const char* name;
+    int territories;
+    int lloydIterations;
+};
+
+extern const MapGenPreset kMapGenPresets[];
+extern const int kNumMapGenPresets;
+
+const MapGenPreset* findMapGenPreset(const char* name);
+
+// Deterministic map over the whole globe: jittered seeds, Lloyd-relaxed
+// Voronoi cells clipped to [-1,1]x[-1,1], continents grown over the
+// adjacency graph. The same options give the same map bit for bit, and
+// vertices shared by neighboring cells are bit-identical, so borders
+// match exactly for the LOD and the pick raster.
+void generateVoronoiMap(const MapGenOptions &opt, MapSource &out);
+
+#endif